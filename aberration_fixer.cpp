@@ -7,85 +7,152 @@ module;
 #include <opencv2/opencv.hpp>
 
 export module aberration_fixer;
+import frame_metadata;
 import utils;
 
 namespace
 {
-    cv::Mat enhanceContrast(const cv::Mat& image)
+    void enhanceContrast(const cv::Mat& image, cv::Mat& enhanced)
     {
-        cv::Mat enhanced;
-        cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE();
+        thread_local const cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE();
         clahe->apply(image, enhanced);
-        return enhanced;
     }
+}
+
 
-    cv::Mat alignChannel(const cv::Mat& referenceChannel, const cv::Mat& channel)
+export cv::Matx33d alignChannel(const cv::Mat& referenceChannel, const cv::Mat& channel, cv::Mat& alignedChannel)
+{
+    cv::Mat& enhancedRef = Utils::threadBuffer("enhancedRef", referenceChannel.size(), referenceChannel.type());
+    cv::Mat& enhancedCh = Utils::threadBuffer("enhancedCh", channel.size(), channel.type());
+    enhanceContrast(referenceChannel, enhancedRef);
+    enhanceContrast(channel, enhancedCh);
+
+    // ORB works with 8 bit images only
+    const cv::Mat& featuresRef = Utils::to8Bit(enhancedRef, Utils::threadBuffer("featuresRef", referenceChannel.size(), CV_8UC1));
+    const cv::Mat& featuresCh = Utils::to8Bit(enhancedCh, Utils::threadBuffer("featuresCh", channel.size(), CV_8UC1));
+
+    // ORB detector and matcher
+    thread_local const cv::Ptr<cv::ORB> orb = cv::ORB::create();
+    std::vector<cv::KeyPoint> kpRef, kp;
+    cv::Mat desRef, des;
+
+    // Detect and compute features for reference and target channels
+    orb->detectAndCompute(featuresRef, cv::noArray(), kpRef, desRef);
+    orb->detectAndCompute(featuresCh, cv::noArray(), kp, des);
+
+    // Brute-force matcher with Hamming distance
+    cv::BFMatcher bf(cv::NORM_HAMMING, true);
+    std::vector<cv::DMatch> matches;
+    bf.match(desRef, des, matches);
+    std::sort(matches.begin(), matches.end(), [](const cv::DMatch& a, const cv::DMatch& b) { return a.distance < b.distance; });
+
+    // Extract matched points
+    std::vector<cv::Point2f> srcPts, dstPts;
+    for (size_t i = 0; i < matches.size(); ++i)
     {
-        cv::Mat enhancedRef = enhanceContrast(referenceChannel);
-        cv::Mat enhancedCh = enhanceContrast(channel);
-
-        // ORB detector and matcher
-        cv::Ptr<cv::ORB> orb = cv::ORB::create();
-        std::vector<cv::KeyPoint> kpRef, kp;
-        cv::Mat desRef, des;
-
-        // Detect and compute features for reference and target channels
-        orb->detectAndCompute(enhancedRef, cv::noArray(), kpRef, desRef);
-        orb->detectAndCompute(enhancedCh, cv::noArray(), kp, des);
-
-        // Brute-force matcher with Hamming distance
-        cv::BFMatcher bf(cv::NORM_HAMMING, true);
-        std::vector<cv::DMatch> matches;
-        bf.match(desRef, des, matches);
-        std::sort(matches.begin(), matches.end(), [](const cv::DMatch& a, const cv::DMatch& b) { return a.distance < b.distance; });
-
-        // Extract matched points
-        std::vector<cv::Point2f> srcPts, dstPts;
-        for (size_t i = 0; i < matches.size(); ++i)
-        {
-            srcPts.push_back(kp[matches[i].trainIdx].pt);
-            dstPts.push_back(kpRef[matches[i].queryIdx].pt);
-        }
+        srcPts.push_back(kp[matches[i].trainIdx].pt);
+        dstPts.push_back(kpRef[matches[i].queryIdx].pt);
+    }
+
+    // Find homography and warp the channel
+    const cv::Mat homography = cv::findHomography(srcPts, dstPts, cv::RANSAC);
 
-        // Find homography and warp the channel
-        const cv::Mat homography = cv::findHomography(srcPts, dstPts, cv::RANSAC);
+    cv::warpPerspective(channel, alignedChannel, homography, referenceChannel.size());
 
-        cv::Mat alignedChannel;
-        cv::warpPerspective(channel, alignedChannel, homography, referenceChannel.size());
+    return homography;
+}
 
-        return alignedChannel;
+
+export cv::Matx33d shiftChannel(const cv::Mat& referenceChannel, const cv::Mat& channel, cv::Mat& alignedChannel)
+{
+    if (referenceChannel.cols < 2 || referenceChannel.rows < 2)
+    {
+        channel.copyTo(alignedChannel);
+        return cv::Matx33d::eye();
     }
+
+    cv::Mat& referenceFloat = Utils::threadBuffer("referenceFloat", referenceChannel.size(), CV_32F);
+    cv::Mat& channelFloat = Utils::threadBuffer("channelFloat", channel.size(), CV_32F);
+    referenceChannel.convertTo(referenceFloat, CV_32F);
+    channel.convertTo(channelFloat, CV_32F);
+
+    // window suppresses edge effects of the FFT used by phase correlation
+    cv::Mat& window = Utils::threadBuffer("hanningWindow", referenceChannel.size(), CV_32F);
+    cv::createHanningWindow(window, referenceChannel.size(), CV_32F);
+
+    // sub-pixel shift of the channel relative to the reference
+    const cv::Point2d shift = cv::phaseCorrelate(referenceFloat, channelFloat, window);
+
+    const cv::Mat translation = (cv::Mat_<double>(2, 3) << 1, 0, -shift.x, 0, 1, -shift.y);
+
+    cv::warpAffine(channel, alignedChannel, translation, referenceChannel.size(), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+
+    return cv::Matx33d(1, 0, -shift.x, 0, 1, -shift.y, 0, 0, 1);
 }
 
 
-export std::vector<std::filesystem::path> fixChromaticAberration(const std::filesystem::path& dir, std::span<const std::filesystem::path> images, bool debug)
+export enum class ChromaticAberrationMethod
+{
+    Homography,         // ORB features + RANSAC homography per channel
+    Shift,              // sub-pixel translation found with phase correlation
+};
+
+
+export std::vector<std::filesystem::path> fixChromaticAberration(const std::filesystem::path& dir, std::span<const std::filesystem::path> images, ChromaticAberrationMethod method, bool debug)
 {
+    // there is no chromatic aberration in mono images
+    if (images.empty() == false && Utils::readImage(images.front()).channels() == 1)
+        return Utils::linkFiles(images, dir);
+
     const auto rDir = dir / "_red";
     const auto gDir = dir / "_green";
     const auto bDir = dir / "_blue";
     const auto fDir = dir / "fixed";
 
     const std::array dirs{fDir, rDir, gDir, bDir};
-    const auto fixed = Utils::processImages(images, dirs, debug, [](const auto& image)
+    const auto metadata = frameMetadata(dir);
+
+    const auto fixed = Utils::processImages(images, dirs, debug, [method, debug, &metadata](const cv::Mat& image, const std::filesystem::path& path)
     {
+        const cv::Size size = image.size();
+        const int type = CV_MAKETYPE(image.depth(), 1);
+
         // Split the image into B, G, R channels
-        std::vector<cv::Mat> channels(3);
+        std::vector<cv::Mat> channels = {
+            Utils::threadBuffer("blue", size, type),
+            Utils::threadBuffer("green", size, type),
+            Utils::threadBuffer("red", size, type),
+        };
         cv::split(image, channels);
 
         const auto& b = channels[0];
         const auto& g = channels[1];
         const auto& r = channels[2];
 
-        const cv::Mat alignedR = alignChannel(g, r);
-        const cv::Mat alignedB = alignChannel(g, b);
+        const auto align = method == ChromaticAberrationMethod::Shift? shiftChannel: alignChannel;
+
+        cv::Mat& alignedR = Utils::threadBuffer("alignedRed", size, type);
+        cv::Mat& alignedB = Utils::threadBuffer("alignedBlue", size, type);
+        const auto redTransform = align(g, r, alignedR);
+        const auto blueTransform = align(g, b, alignedB);
+
+        updateFrameMetadata(metadata, path, [&](FrameRecord& record)
+        {
+            record.redTransform = redTransform;
+            record.blueTransform = blueTransform;
+        });
 
         // Merge the aligned channels back into one image
-        std::vector<cv::Mat> alignedChannels = { alignedB, g, alignedR };
+        const std::vector<cv::Mat> alignedChannels = { alignedB, g, alignedR };
 
         cv::Mat correctedImage;
         cv::merge(alignedChannels, correctedImage);
 
-        return std::array{correctedImage, r, g, b};
+        // channels live in thread's buffers, they need own copies to outlive this function
+        if (debug)
+            return std::array{correctedImage, r.clone(), g.clone(), b.clone()};
+        else
+            return std::array{correctedImage, cv::Mat(), cv::Mat(), cv::Mat()};
     });
 
     return fixed;
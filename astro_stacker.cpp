@@ -0,0 +1,105 @@
+module;
+
+#include <atomic>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+export module astro_stacker;
+import execution_plan_builder;
+import frame_metadata;
+import memory_file_manager;
+export import stacking_pipeline;
+import utils;
+
+
+// In-memory API for embedding stacking in other applications (like capture software).
+// Frames are passed and stacks returned as cv::Mat, nothing is written to disk.
+namespace AstroStacker
+{
+    namespace
+    {
+        std::atomic<size_t> runs = 0;
+    }
+
+    // Result of stacking frames (or frames of one sliding window), enhanced
+    export struct Stack
+    {
+        cv::Mat average;
+        cv::Mat median;
+    };
+
+    // Stackers keep their images in own storage, registered for their working directories only (see Utils::registerFileManager),
+    // so many stackers, and command line processing, can run in one process at the same time.
+    export class Stacker
+    {
+    public:
+        explicit Stacker(PipelineOptions options = {})
+            : m_options(std::move(options))
+        {
+
+        }
+
+        Stacker(const Stacker &) = delete;
+        Stacker& operator=(const Stacker &) = delete;
+
+        // Process frames (8 or 16 bit, one or three channels, or raw mosaics when PipelineOptions::bayer is set).
+        // Returns one stack, or one per window for sliding windows (windows without aligned frames are skipped).
+        // Frames are not copied and must not be modified until call returns.
+        std::vector<Stack> stack(std::span<const cv::Mat> frames)
+        {
+            // each call works in its own virtual directory, so stacker can be used from many threads
+            const std::filesystem::path dir = std::format("astro-stacker-{}", runs++);
+            const Utils::FileManagerRegistration fileManagerRegistration(dir, m_files);
+            const Utils::WorkingDir wd(dir);
+
+            const auto metadata = std::make_shared<FrameMetadata>();
+            const FrameMetadataRegistration metadataRegistration(dir, metadata);
+
+            if (m_options.bayer)
+                metadata->setBayerPattern(*m_options.bayer);
+
+            std::vector<std::filesystem::path> framePaths;
+            framePaths.reserve(frames.size());
+
+            for (size_t i = 0; i < frames.size(); i++)
+            {
+                framePaths.push_back(dir / "frames" / std::format("{}.png", i));
+                m_files.add(framePaths.back(), frames[i]);
+
+                updateFrameMetadata(metadata, framePaths.back(), [&](FrameRecord& record)
+                {
+                    record.size = frames[i].size();
+                });
+            }
+
+            ExecutionPlanBuilder epb(wd, m_files);
+            addProcessingSteps(epb, m_options);
+
+            // stacking steps produce average and median image of each stack, in this order
+            const auto results = epb.execute(framePaths);
+            if (results.size() % 2 != 0)
+                throw std::runtime_error("Unexpected number of stacking results: " + std::to_string(results.size()));
+
+            std::vector<Stack> stacks;
+            for (size_t i = 0; i < results.size(); i += 2)
+                stacks.push_back(Stack{
+                    .average = m_files.read(results[i], cv::IMREAD_UNCHANGED),
+                    .median = m_files.read(results[i + 1], cv::IMREAD_UNCHANGED),
+                });
+
+            m_files.remove(dir);
+
+            return stacks;
+        }
+
+    private:
+        const PipelineOptions m_options;
+        MemoryFileManager m_files;
+    };
+}
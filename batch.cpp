@@ -0,0 +1,74 @@
+module;
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <ranges>
+#include <span>
+#include <string>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+export module batch;
+import utils;
+
+
+// Names of working directories for batch jobs. Based on input names, made unique when inputs share names.
+export std::vector<std::string> jobNames(std::span<const std::filesystem::path> inputs)
+{
+    const auto files = inputs | std::views::transform([](const std::filesystem::path& input)
+    {
+        return input.has_filename()? input: input.parent_path();
+    }) | std::ranges::to<std::vector>();
+
+    const auto names = Utils::uniqueFileNames(files) | std::views::transform([](const std::filesystem::path& name)
+    {
+        return name.stem().string();
+    });
+
+    return {names.begin(), names.end()};
+}
+
+
+// Process each input with 'process' (called with input and its job name), up to 'parallelJobs' inputs at once.
+// Inputs are processed as jobs running in their own threads and sharing the global task pool for their computations,
+// so serial parts of one job overlap with work of others. Failure of one job does not stop the others. Returns number of failed jobs.
+// Jobs do not run as tasks of the global pool, as they could occupy all its threads while waiting for their own tasks.
+export size_t processBatch(std::span<const std::filesystem::path> inputs, size_t parallelJobs,
+                           const std::function<void(const std::filesystem::path& input, const std::string& name)>& process)
+{
+    const auto names = jobNames(inputs);
+    parallelJobs = std::min(std::max<size_t>(parallelJobs, 1), inputs.size());
+
+    std::atomic<size_t> nextJob = 0;
+    std::atomic<size_t> failedJobs = 0;
+
+    Utils::TaskPool jobsPool(parallelJobs + 1);
+    Utils::TaskGroup jobs(jobsPool);
+
+    for (size_t i = 0; i < parallelJobs; i++)
+        jobs.run([&]
+        {
+            for (size_t job = nextJob++; job < inputs.size(); job = nextJob++)
+            {
+                const auto& input = inputs[job];
+                spdlog::info("Processing job {} of {}: {}", job + 1, inputs.size(), input.string());
+
+                try
+                {
+                    process(input, names[job]);
+                }
+                catch (const std::exception& error)
+                {
+                    spdlog::error("Processing of {} failed: {}", input.string(), error.what());
+                    failedJobs++;
+                }
+            }
+        });
+
+    jobs.wait();
+
+    return failedJobs;
+}
@@ -0,0 +1,149 @@
+
+module;
+
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+export module bayer;
+import utils;
+
+
+// Color filter array layout, named after colors of top-left 2x2 cell (row by row)
+export enum class BayerPattern
+{
+    RGGB,
+    BGGR,
+    GRBG,
+    GBRG,
+};
+
+
+export std::optional<BayerPattern> readBayerPattern(std::string_view pattern)
+{
+    if (pattern == "RGGB" || pattern == "rggb")
+        return BayerPattern::RGGB;
+    else if (pattern == "BGGR" || pattern == "bggr")
+        return BayerPattern::BGGR;
+    else if (pattern == "GRBG" || pattern == "grbg")
+        return BayerPattern::GRBG;
+    else if (pattern == "GBRG" || pattern == "gbrg")
+        return BayerPattern::GBRG;
+    else
+        return {};
+}
+
+
+// Region covering whole 2x2 cells, so cropped mosaic keeps its pattern
+export cv::Rect alignToCfa(const cv::Rect& rect)
+{
+    const int x = rect.x & ~1;
+    const int y = rect.y & ~1;
+
+    return cv::Rect(x, y, (rect.x + rect.width - x) & ~1, (rect.y + rect.height - y) & ~1);
+}
+
+
+// Half resolution plane of mosaic: pixels at given position (0 - 3: top-left, top-right, bottom-left, bottom-right) of each 2x2 cell
+export cv::Mat cfaPlane(const cv::Mat& mosaic, int position)
+{
+    const int dx = position % 2;
+    const int dy = position / 2;
+    const size_t pixelSize = mosaic.elemSize();
+
+    cv::Mat plane(mosaic.rows / 2, mosaic.cols / 2, mosaic.type());
+
+    for (int y = 0; y < plane.rows; y++)
+    {
+        const uchar* src = mosaic.ptr<uchar>(2 * y + dy) + dx * pixelSize;
+        uchar* dst = plane.ptr<uchar>(y);
+
+        for (int x = 0; x < plane.cols; x++)
+            std::memcpy(dst + x * pixelSize, src + 2 * x * pixelSize, pixelSize);
+    }
+
+    return plane;
+}
+
+
+export std::array<cv::Mat, 4> splitCfa(const cv::Mat& mosaic)
+{
+    return {cfaPlane(mosaic, 0), cfaPlane(mosaic, 1), cfaPlane(mosaic, 2), cfaPlane(mosaic, 3)};
+}
+
+
+export cv::Mat mergeCfa(const std::array<cv::Mat, 4>& planes)
+{
+    const cv::Mat& first = planes.front();
+    const size_t pixelSize = first.elemSize();
+
+    cv::Mat mosaic(first.rows * 2, first.cols * 2, first.type());
+
+    for (int position = 0; position < 4; position++)
+    {
+        const int dx = position % 2;
+        const int dy = position / 2;
+
+        for (int y = 0; y < first.rows; y++)
+        {
+            const uchar* src = planes[position].ptr<uchar>(y);
+            uchar* dst = mosaic.ptr<uchar>(2 * y + dy) + dx * pixelSize;
+
+            for (int x = 0; x < first.cols; x++)
+                std::memcpy(dst + 2 * x * pixelSize, src + x * pixelSize, pixelSize);
+        }
+    }
+
+    return mosaic;
+}
+
+
+// Half resolution luminance: average of each 2x2 cell
+export cv::Mat cfaLuma(const cv::Mat& mosaic)
+{
+    cv::Mat luma;
+    cv::resize(mosaic(cv::Rect(0, 0, mosaic.cols & ~1, mosaic.rows & ~1)), luma, cv::Size(mosaic.cols / 2, mosaic.rows / 2), 0, 0, cv::INTER_AREA);
+
+    return luma;
+}
+
+
+// Half resolution green channel (one of two green pixels of each cell)
+export cv::Mat cfaGreen(const cv::Mat& mosaic, BayerPattern pattern)
+{
+    const bool greenFirst = pattern == BayerPattern::GRBG || pattern == BayerPattern::GBRG;
+    return cfaPlane(mosaic, greenFirst? 0: 1);
+}
+
+
+export cv::Mat debayer(const cv::Mat& mosaic, BayerPattern pattern)
+{
+    // OpenCV names Bayer conversions after second row's second and third pixels, not after top-left cell
+    int code = cv::COLOR_BayerBG2BGR;
+    switch (pattern)
+    {
+        case BayerPattern::RGGB: code = cv::COLOR_BayerBG2BGR; break;
+        case BayerPattern::BGGR: code = cv::COLOR_BayerRG2BGR; break;
+        case BayerPattern::GRBG: code = cv::COLOR_BayerGB2BGR; break;
+        case BayerPattern::GBRG: code = cv::COLOR_BayerGR2BGR; break;
+    }
+
+    cv::Mat result;
+    cv::cvtColor(mosaic, result, code);
+
+    return result;
+}
+
+
+export std::vector<std::filesystem::path> debayerImages(const std::filesystem::path& dir, std::span<const std::filesystem::path> images, BayerPattern pattern)
+{
+    return Utils::processImages(images, dir, Utils::ImageRole::Output, [pattern](const cv::Mat& image)
+    {
+        return debayer(image, pattern);
+    });
+}
@@ -0,0 +1,78 @@
+import argparse
+import os
+import subprocess
+import tempfile
+import time
+
+
+CODECS = [
+    None,                   # OpenCV defaults
+    "png:0",
+    "png:1",
+    "png:1:rle",
+    "png:3",
+    "png:9",
+    "tiff",
+    "tiff:lzw",
+    "bmp",
+]
+
+
+def directory_size(directory):
+    size = 0
+
+    for root, _, files in os.walk(directory):
+        for file in files:
+            path = os.path.join(root, file)
+            if not os.path.islink(path):
+                size += os.path.getsize(path)
+
+    return size
+
+
+def run_codec(app_path, input_file, codec, extra_args):
+    """
+    Runs astro-stacker with given intermediate codec.
+
+    Returns:
+        tuple: wall time in seconds and size of working directory in bytes.
+    """
+    with tempfile.TemporaryDirectory() as temp_dir:
+        args = [app_path, "--working-dir", temp_dir] + extra_args
+        if codec is not None:
+            args += ["--intermediate-codec", codec]
+        args.append(input_file)
+
+        start = time.perf_counter()
+        result = subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+        elapsed = time.perf_counter() - start
+
+        if result.returncode != 0:
+            raise Exception(f"astro-stacker failed for codec {codec}: {result.stdout} {result.stderr}")
+
+        return elapsed, directory_size(temp_dir)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare throughput and disk usage of intermediate image codecs.")
+    parser.add_argument("--app", default=os.environ.get("AS_PATH"), help="path to astro-stacker executable (default: $AS_PATH)")
+    parser.add_argument("--repeat", type=int, default=3, help="number of runs for each codec, best time is reported")
+    parser.add_argument("--args", default="", help="additional arguments for astro-stacker")
+    parser.add_argument("input", nargs="?", default=os.path.join(os.path.dirname(__file__), "..", "tests", "video-files", "moon.mp4"))
+    options = parser.parse_args()
+
+    if options.app is None or os.path.isfile(options.app) == False:
+        raise Exception("Provide path to astro-stacker executable with --app or AS_PATH environmental variable")
+
+    print(f"{'codec':<12} {'time [s]':>10} {'disk [MiB]':>12}")
+
+    for codec in CODECS:
+        runs = [run_codec(options.app, options.input, codec, options.args.split()) for _ in range(options.repeat)]
+        best_time = min(run[0] for run in runs)
+        disk = runs[0][1] / (1024 * 1024)
+
+        print(f"{codec or 'default':<12} {best_time:>10.2f} {disk:>12.1f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,293 @@
+
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <format>
+#include <optional>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+import aberration_fixer;
+import images_aligner;
+import images_enhancer;
+import images_picker;
+import images_stacker;
+import memory_file_manager;
+import object_localizer;
+import star_matcher;
+import synthetic_capture;
+import transparency_applier;
+import utils;
+
+
+namespace
+{
+    // Frames are deterministic for given size and index, so results of runs can be compared
+    cv::Mat planetFrame(int size, size_t index = 0)
+    {
+        const SyntheticCapture capture({.size = {size, size}});
+        return capture.frame(index);
+    }
+
+    cv::Mat grayFrame(int size, size_t index = 0)
+    {
+        cv::Mat gray;
+        cv::cvtColor(planetFrame(size, index), gray, cv::COLOR_BGR2GRAY);
+
+        return gray;
+    }
+
+    // Sparse field of stars of different brightness, like deep sky captures
+    cv::Mat starFrame(int size)
+    {
+        cv::RNG rng(1);
+        cv::Mat frame(size, size, CV_8UC1, cv::Scalar(10));
+
+        for (int i = 0; i < 60; i++)
+        {
+            const cv::Point2f star(rng.uniform(0.f, static_cast<float>(size)), rng.uniform(0.f, static_cast<float>(size)));
+            cv::circle(frame, star, rng.uniform(1, 3), cv::Scalar(rng.uniform(80, 255)), cv::FILLED, cv::LINE_AA);
+        }
+
+        cv::Mat noise(frame.size(), CV_16SC1);
+        rng.fill(noise, cv::RNG::NORMAL, 0, 3);
+        cv::add(frame, noise, frame, cv::noArray(), CV_8UC1);
+
+        return frame;
+    }
+
+    // Frame moved by given offset, as if telescope drifted
+    cv::Mat shifted(const cv::Mat& image, double dx, double dy)
+    {
+        const cv::Mat translation = (cv::Mat_<double>(2, 3) << 1, 0, dx, 0, 1, dy);
+
+        cv::Mat result;
+        cv::warpAffine(image, result, translation, image.size(), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+
+        return result;
+    }
+
+    void setThroughput(benchmark::State& state, double pixels)
+    {
+        state.counters["MPix/s"] = benchmark::Counter(pixels / 1e6, benchmark::Counter::kIsIterationInvariantRate);
+    }
+
+    // Frames for stacking are kept in memory, so only stacking itself is measured.
+    // Arguments: frame size, number of frames and bits per sample (8 or 16)
+    class StackingFixture: public benchmark::Fixture
+    {
+    public:
+        void SetUp(benchmark::State& state) override
+        {
+            const auto size = static_cast<int>(state.range(0));
+            const auto frames = static_cast<size_t>(state.range(1));
+            const bool deep = state.range(2) == 16;
+
+            m_registration.emplace("/bench", m_fileManager);
+
+            for (size_t i = 0; i < frames; i++)
+            {
+                cv::Mat frame = planetFrame(size, i);
+                if (deep)
+                    frame.convertTo(frame, CV_16UC3, 257);
+
+                const auto path = std::filesystem::path("/bench") / std::format("{}.png", i);
+                m_fileManager.write(path, frame, {});
+                m_images.push_back(path);
+            }
+        }
+
+        void TearDown(benchmark::State &) override
+        {
+            m_fileManager.remove("/bench");
+            m_images.clear();
+            m_registration.reset();
+        }
+
+    protected:
+        MemoryFileManager m_fileManager;
+        std::optional<Utils::FileManagerRegistration> m_registration;      // frames are read through fixture's storage only while it runs
+        std::vector<std::filesystem::path> m_images;
+    };
+}
+
+
+static void BM_computeSharpness(benchmark::State& state)
+{
+    const auto gray = grayFrame(static_cast<int>(state.range(0)));
+
+    for (auto _: state)
+        benchmark::DoNotOptimize(computeSharpness(gray));
+
+    setThroughput(state, gray.total());
+}
+
+
+static void BM_computeContrast(benchmark::State& state)
+{
+    const auto gray = grayFrame(static_cast<int>(state.range(0)));
+
+    for (auto _: state)
+        benchmark::DoNotOptimize(computeContrast(gray));
+
+    setThroughput(state, gray.total());
+}
+
+
+static void BM_findTransformation(benchmark::State& state)
+{
+    const auto reference = grayFrame(static_cast<int>(state.range(0)));
+    const auto image = shifted(reference, 2.5, -1.5);
+
+    for (auto _: state)
+        benchmark::DoNotOptimize(findTransformation(reference, image).transformation);
+
+    setThroughput(state, reference.total());
+}
+
+
+// Star field of reference is detected once per alignment, so only the aligned frame's side is measured
+static void BM_matchStarFields(benchmark::State& state)
+{
+    const auto reference = starFrame(static_cast<int>(state.range(0)));
+    const auto image = shifted(reference, 2.5, -1.5);
+    const auto referenceField = detectStarField(reference);
+
+    for (auto _: state)
+        benchmark::DoNotOptimize(matchStarFields(referenceField, detectStarField(image)));
+
+    setThroughput(state, reference.total());
+}
+
+
+static void BM_alignChannel(benchmark::State& state)
+{
+    const auto frame = planetFrame(static_cast<int>(state.range(0)));
+
+    std::vector<cv::Mat> channels;
+    cv::split(frame, channels);
+    const auto red = shifted(channels[2], 1.5, 0.5);
+
+    cv::Mat aligned;
+    for (auto _: state)
+        benchmark::DoNotOptimize(alignChannel(channels[1], red, aligned));
+
+    setThroughput(state, frame.total());
+}
+
+
+static void BM_shiftChannel(benchmark::State& state)
+{
+    const auto frame = planetFrame(static_cast<int>(state.range(0)));
+
+    std::vector<cv::Mat> channels;
+    cv::split(frame, channels);
+    const auto red = shifted(channels[2], 1.5, 0.5);
+
+    cv::Mat aligned;
+    for (auto _: state)
+        benchmark::DoNotOptimize(shiftChannel(channels[1], red, aligned));
+
+    setThroughput(state, frame.total());
+}
+
+
+static void BM_findBrightestObject(benchmark::State& state)
+{
+    const auto frame = planetFrame(static_cast<int>(state.range(0)));
+
+    for (auto _: state)
+        benchmark::DoNotOptimize(findBrightestObject(frame, false));
+
+    setThroughput(state, frame.total());
+}
+
+
+BENCHMARK_DEFINE_F(StackingFixture, averageStacking)(benchmark::State& state)
+{
+    for (auto _: state)
+        benchmark::DoNotOptimize(averageStacking(m_images));
+
+    setThroughput(state, static_cast<double>(state.range(0) * state.range(0) * state.range(1)));
+}
+
+
+BENCHMARK_DEFINE_F(StackingFixture, medianStacking)(benchmark::State& state)
+{
+    for (auto _: state)
+        benchmark::DoNotOptimize(medianStacking(m_images));
+
+    setThroughput(state, static_cast<double>(state.range(0) * state.range(0) * state.range(1)));
+}
+
+
+static void BM_richardsonLucyDeconvolution(benchmark::State& state)
+{
+    const auto frame = planetFrame(static_cast<int>(state.range(0)));
+
+    // the same PSF as used by enhanceImages
+    cv::Mat psf = cv::getGaussianKernel(21, 5, CV_32F);
+    psf = psf * psf.t();
+
+    for (auto _: state)
+        benchmark::DoNotOptimize(richardsonLucyDeconvolution(frame, psf, 10));
+
+    setThroughput(state, frame.total());
+}
+
+
+static void BM_makeTransparent(benchmark::State& state)
+{
+    const auto frame = planetFrame(static_cast<int>(state.range(0)));
+
+    for (auto _: state)
+        benchmark::DoNotOptimize(makeTransparent(frame, 10));
+
+    setThroughput(state, frame.total());
+}
+
+
+static void BM_encodePng(benchmark::State& state)
+{
+    const auto frame = planetFrame(static_cast<int>(state.range(0)));
+
+    std::vector<uchar> buffer;
+    for (auto _: state)
+        benchmark::DoNotOptimize(cv::imencode(".png", frame, buffer));
+
+    setThroughput(state, frame.total());
+}
+
+
+static void BM_decodePng(benchmark::State& state)
+{
+    const auto frame = planetFrame(static_cast<int>(state.range(0)));
+
+    std::vector<uchar> buffer;
+    cv::imencode(".png", frame, buffer);
+
+    for (auto _: state)
+        benchmark::DoNotOptimize(cv::imdecode(buffer, cv::IMREAD_COLOR));
+
+    setThroughput(state, frame.total());
+}
+
+
+// frame sizes: small crop of planet, typical crop and full HD-like frame
+#define FRAME_SIZES ->Arg(256)->Arg(512)->Arg(1024)->Unit(benchmark::kMillisecond)
+
+BENCHMARK(BM_computeSharpness) FRAME_SIZES;
+BENCHMARK(BM_computeContrast) FRAME_SIZES;
+BENCHMARK(BM_findTransformation)->Arg(256)->Arg(512)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_matchStarFields) FRAME_SIZES;
+BENCHMARK(BM_alignChannel) FRAME_SIZES;
+BENCHMARK(BM_shiftChannel) FRAME_SIZES;
+BENCHMARK(BM_findBrightestObject) FRAME_SIZES;
+BENCHMARK(BM_richardsonLucyDeconvolution) FRAME_SIZES;
+BENCHMARK(BM_makeTransparent) FRAME_SIZES;
+BENCHMARK(BM_encodePng) FRAME_SIZES;
+BENCHMARK(BM_decodePng) FRAME_SIZES;
+
+// frame size and number of frames
+BENCHMARK_REGISTER_F(StackingFixture, averageStacking)->ArgsProduct({{256, 512}, {16, 64}, {8, 16}})->Unit(benchmark::kMillisecond);
+BENCHMARK_REGISTER_F(StackingFixture, medianStacking)->ArgsProduct({{256, 512}, {16, 64}, {8, 16}})->Unit(benchmark::kMillisecond);
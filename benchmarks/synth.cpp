@@ -0,0 +1,110 @@
+
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <boost/program_options.hpp>
+#include <opencv2/opencv.hpp>
+
+import synthetic_capture;
+
+
+namespace po = boost::program_options;
+
+namespace
+{
+    // Video formats supported by OpenCV without external libraries, so capture can be generated offline
+    bool isVideo(const std::filesystem::path& output)
+    {
+        return output.extension() == ".avi";
+    }
+
+    void writeVideo(const SyntheticCapture& capture, const std::filesystem::path& output, size_t frames, const cv::Size& size, double fps)
+    {
+        cv::VideoWriter writer(output.string(), cv::CAP_OPENCV_MJPEG, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), fps, size);
+        if (writer.isOpened() == false)
+            throw std::runtime_error("Could not open " + output.string() + " for writing");
+
+        for (size_t i = 0; i < frames; i++)
+            writer.write(capture.frame(i));
+    }
+
+    void writeImages(const SyntheticCapture& capture, const std::filesystem::path& output, size_t frames)
+    {
+        std::filesystem::create_directories(output);
+
+        for (size_t i = 0; i < frames; i++)
+        {
+            const auto path = output / std::format("{:06}.png", i);
+            if (cv::imwrite(path.string(), capture.frame(i)) == false)
+                throw std::runtime_error("Could not write " + path.string());
+        }
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    po::options_description desc("Generates synthetic capture of a planet. Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("frames", po::value<size_t>()->default_value(200), "number of frames")
+        ("size", po::value<std::string>()->default_value("640x480"), "frame size (WxH)")
+        ("seed", po::value<unsigned>()->default_value(0), "seed of random generator")
+        ("jitter", po::value<double>()->default_value(3.0), "standard deviation of object's position in pixels")
+        ("seeing", po::value<double>()->default_value(1.5), "mean sigma of atmospheric blur in pixels")
+        ("noise", po::value<double>()->default_value(4.0), "standard deviation of sensor noise")
+        ("dispersion", po::value<double>()->default_value(1.0), "shift of red and blue channels in pixels")
+        ("fps", po::value<double>()->default_value(30.0), "frame rate of generated video")
+        ("output", po::value<std::string>(), "output video (.avi) or directory for images")
+    ;
+
+    po::positional_options_description positional;
+    positional.add("output", 1);
+
+    try
+    {
+        po::variables_map vm;
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help") || vm.count("output") == 0)
+        {
+            std::cout << desc << std::endl;
+            return vm.count("help")? 0: 1;
+        }
+
+        int width = 0, height = 0;
+        char separator = 0;
+        std::istringstream sizeStream(vm["size"].as<std::string>());
+        if (!(sizeStream >> width >> separator >> height) || separator != 'x' || width <= 0 || height <= 0)
+            throw std::invalid_argument("Invalid frame size: " + vm["size"].as<std::string>());
+
+        const CaptureParameters parameters {
+            .size = {width, height},
+            .seed = vm["seed"].as<unsigned>(),
+            .jitter = vm["jitter"].as<double>(),
+            .seeing = vm["seeing"].as<double>(),
+            .noise = vm["noise"].as<double>(),
+            .dispersion = vm["dispersion"].as<double>(),
+        };
+
+        const SyntheticCapture capture(parameters);
+        const std::filesystem::path output = vm["output"].as<std::string>();
+        const auto frames = vm["frames"].as<size_t>();
+
+        if (isVideo(output))
+            writeVideo(capture, output, frames, parameters.size, vm["fps"].as<double>());
+        else
+            writeImages(capture, output, frames);
+    }
+    catch(const std::exception& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
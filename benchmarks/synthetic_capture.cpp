@@ -0,0 +1,95 @@
+
+module;
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+export module synthetic_capture;
+
+
+export struct CaptureParameters
+{
+    cv::Size size = {640, 480};
+    unsigned seed = 0;
+    double jitter = 3.0;            // standard deviation of object's position [px]
+    double seeing = 1.5;            // mean sigma of atmospheric blur [px]
+    double noise = 4.0;             // standard deviation of sensor noise
+    double dispersion = 1.0;        // vertical shift of red (down) and blue (up) channels [px]
+};
+
+
+// Deterministic capture of a planet observed through turbulent atmosphere.
+// Each frame depends only on parameters and its index, so frames can be generated in any order.
+export class SyntheticCapture
+{
+public:
+    explicit SyntheticCapture(const CaptureParameters& parameters)
+        : m_parameters(parameters)
+        , m_planet(renderPlanet(parameters))
+    {
+
+    }
+
+    cv::Mat frame(size_t index) const
+    {
+        cv::RNG rng(static_cast<std::uint64_t>(m_parameters.seed) * 1000003 + index + 1);
+
+        // seeing: object moves and gets blurred differently in each frame
+        const double dx = rng.gaussian(m_parameters.jitter);
+        const double dy = rng.gaussian(m_parameters.jitter);
+        const double blur = m_parameters.seeing * rng.uniform(0.5, 1.5);
+
+        std::vector<cv::Mat> channels;
+        cv::split(m_planet, channels);
+
+        // atmospheric dispersion: red and blue images are shifted vertically in opposite directions
+        const double channelShift[] = {-m_parameters.dispersion, 0.0, m_parameters.dispersion};
+
+        for (size_t c = 0; c < channels.size(); c++)
+        {
+            const cv::Mat translation = (cv::Mat_<double>(2, 3) << 1, 0, dx, 0, 1, dy + channelShift[c]);
+            cv::warpAffine(channels[c], channels[c], translation, m_planet.size(), cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+        }
+
+        cv::Mat result;
+        cv::merge(channels, result);
+
+        if (blur > 0)
+            cv::GaussianBlur(result, result, cv::Size(0, 0), blur);
+
+        cv::Mat noise(result.size(), CV_16SC3);
+        rng.fill(noise, cv::RNG::NORMAL, 0, m_parameters.noise);
+
+        cv::Mat frame;
+        cv::add(result, noise, frame, cv::noArray(), CV_8UC3);
+
+        return frame;
+    }
+
+private:
+    const CaptureParameters m_parameters;
+    const cv::Mat m_planet;
+
+    static cv::Mat renderPlanet(const CaptureParameters& parameters)
+    {
+        cv::RNG rng(parameters.seed + 1);
+
+        const cv::Size& size = parameters.size;
+        const cv::Point center(size.width / 2, size.height / 2);
+        const int radius = std::min(size.width, size.height) / 3;
+
+        cv::Mat planet(size, CV_8UC3, cv::Scalar(0, 0, 0));
+        cv::circle(planet, center, radius, cv::Scalar(170, 180, 190), cv::FILLED, cv::LINE_AA);
+
+        // craters give aligner and sharpness estimator some details to work with
+        for (int i = 0; i < 40; i++)
+        {
+            const cv::Point crater(center.x + rng.uniform(-radius / 2, radius / 2), center.y + rng.uniform(-radius / 2, radius / 2));
+            cv::circle(planet, crater, rng.uniform(2, std::max(3, radius / 8)), cv::Scalar::all(rng.uniform(90, 150)), cv::FILLED, cv::LINE_AA);
+        }
+
+        return planet;
+    }
+};
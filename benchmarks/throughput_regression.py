@@ -0,0 +1,181 @@
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+try:
+    import resource
+except ImportError:     # not available on Windows
+    resource = None
+
+
+STEP_TIME = re.compile(r"Execution time: ([\d.]+)ms \(step: (.+), images: (\d+)\)")
+
+
+def generate_capture(synth_path, output, frames, size, seed):
+    args = [synth_path, "--frames", str(frames), "--size", size, "--seed", str(seed), output]
+    result = subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+
+    if result.returncode != 0:
+        raise Exception(f"Could not generate synthetic capture: {result.stdout} {result.stderr}")
+
+
+def run_measured(args):
+    """
+    Runs process and waits for it.
+
+    Returns:
+        tuple: exit code, output and peak resident memory of this very process in MiB (None if it cannot be measured).
+    """
+    process = subprocess.Popen(args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    output = process.stdout.read()
+    process.stdout.close()
+
+    if resource is None or hasattr(os, "wait4") == False:
+        return process.wait(), output, None
+
+    # usage of waited process only, not of other children (like capture generator)
+    _, status, usage = os.wait4(process.pid, 0)
+    process.returncode = os.waitstatus_to_exitcode(status)
+
+    maxrss = usage.ru_maxrss
+    memory = maxrss / 1024 if sys.platform != "darwin" else maxrss / (1024 * 1024)
+
+    return process.returncode, output, memory
+
+
+def run_pipeline(app_path, input_file, extra_args):
+    """
+    Runs astro-stacker and collects time and number of images of each step.
+
+    Returns:
+        dict: step name mapped to frames per second, wall time in seconds and peak memory in MiB.
+    """
+    with tempfile.TemporaryDirectory() as temp_dir:
+        args = [app_path, "--working-dir", temp_dir] + extra_args + [input_file]
+
+        start = time.perf_counter()
+        returncode, output, memory = run_measured(args)
+        elapsed = time.perf_counter() - start
+
+        if returncode != 0:
+            raise Exception(f"astro-stacker failed: {output}")
+
+    # steps may be executed for many segments, so sum them up
+    steps = {}
+    for match in STEP_TIME.finditer(output):
+        ms, step, images = float(match.group(1)), match.group(2), int(match.group(3))
+        total_ms, total_images = steps.get(step, (0.0, 0))
+        steps[step] = (total_ms + ms, total_images + images)
+
+    fps = {step: images / (ms / 1000) for step, (ms, images) in steps.items() if ms > 0}
+
+    return fps, elapsed, memory
+
+
+def compare(results, baseline, tolerance):
+    """
+    Returns list of regressions: steps slower than baseline and memory usage above baseline (both with tolerance).
+    """
+    regressions = []
+
+    for step, fps in baseline["steps"].items():
+        current = results["steps"].get(step)
+        if current is None:
+            regressions.append(f"step '{step}' was not executed")
+        elif current < fps * (1 - tolerance):
+            regressions.append(f"step '{step}': {current:.1f} frames/s, baseline: {fps:.1f} frames/s")
+
+    memory = results.get("peak_memory_mib")
+    baseline_memory = baseline.get("peak_memory_mib")
+    if memory is not None and baseline_memory is not None and memory > baseline_memory * (1 + tolerance):
+        regressions.append(f"peak memory: {memory:.0f} MiB, baseline: {baseline_memory:.0f} MiB")
+
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure throughput of each pipeline step on synthetic capture and compare it with baseline.")
+    parser.add_argument("--app", default=os.environ.get("AS_PATH"), help="path to astro-stacker executable (default: $AS_PATH)")
+    parser.add_argument("--synth", default=os.environ.get("AS_SYNTH_PATH"), help="path to astro-stacker-synth executable (default: $AS_SYNTH_PATH)")
+    parser.add_argument("--baseline", default=os.path.join(os.path.dirname(__file__), "throughput_baseline.json"), help="baseline file")
+    parser.add_argument("--update-baseline", action="store_true", help="save results of this run as baseline instead of comparing them")
+    parser.add_argument("--output", help="file for results of this run")
+    parser.add_argument("--frames", type=int, default=200, help="length of synthetic capture")
+    parser.add_argument("--size", default="640x480", help="resolution of synthetic capture")
+    parser.add_argument("--seed", type=int, default=0, help="seed of synthetic capture")
+    parser.add_argument("--format", choices=["video", "images"], default="video", help="synthetic capture as video file or images directory")
+    parser.add_argument("--tolerance", type=float, default=0.3, help="allowed relative slowdown and memory growth")
+    parser.add_argument("--repeat", type=int, default=3, help="number of runs, best throughput of each step is used")
+    parser.add_argument("--args", default="", help="additional arguments for astro-stacker")
+    options = parser.parse_args()
+
+    for name, path in [("astro-stacker", options.app), ("astro-stacker-synth", options.synth)]:
+        if path is None or os.path.isfile(path) == False:
+            raise Exception(f"Path to {name} executable is invalid: '{path}'")
+
+    with tempfile.TemporaryDirectory() as capture_dir:
+        capture = os.path.join(capture_dir, "capture.avi" if options.format == "video" else "capture")
+        generate_capture(options.synth, capture, options.frames, options.size, options.seed)
+
+        steps = {}
+        wall_time = None
+        peak_memory = None
+        for _ in range(options.repeat):
+            fps, elapsed, memory = run_pipeline(options.app, capture, options.args.split())
+            wall_time = elapsed if wall_time is None else min(wall_time, elapsed)
+            if memory is not None:
+                peak_memory = memory if peak_memory is None else max(peak_memory, memory)
+            for step, value in fps.items():
+                steps[step] = max(steps.get(step, 0.0), value)
+
+    results = {
+        "capture": {"frames": options.frames, "size": options.size, "seed": options.seed, "format": options.format, "args": options.args},
+        "steps": steps,
+        "wall_time_s": wall_time,
+        "peak_memory_mib": peak_memory,
+    }
+
+    print(f"{'step':<16} {'frames/s':>10}")
+    for step, fps in steps.items():
+        print(f"{step:<16} {fps:>10.1f}")
+    print(f"wall time: {wall_time:.2f} s")
+    if results["peak_memory_mib"] is not None:
+        print(f"peak memory: {results['peak_memory_mib']:.0f} MiB")
+
+    if options.output:
+        with open(options.output, "w") as f:
+            json.dump(results, f, indent=4)
+
+    if options.update_baseline:
+        with open(options.baseline, "w") as f:
+            json.dump(results, f, indent=4)
+
+        print(f"Results were saved as new baseline in {options.baseline}")
+        return 0
+
+    # missing baseline is an error, so the gate never passes without comparing anything
+    if os.path.isfile(options.baseline) == False:
+        print(f"Baseline {options.baseline} is missing. Record it on the reference machine with --update-baseline")
+        return 1
+
+    with open(options.baseline) as f:
+        baseline = json.load(f)
+
+    if baseline.get("capture") != results["capture"]:
+        print("Baseline was recorded for different capture, record it again with --update-baseline")
+        return 1
+
+    regressions = compare(results, baseline, options.tolerance)
+    for regression in regressions:
+        print(f"Regression: {regression}")
+
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
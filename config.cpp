@@ -1,16 +1,38 @@
 
 module;
 
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
+#include <format>
+#include <fstream>
 #include <iostream>
 #include <optional>
+#include <string>
+#include <vector>
+#include <boost/algorithm/string.hpp>
 #include <boost/program_options.hpp>
 
 export module config;
+import aberration_fixer;
+import bayer;
+import images_aligner;
 import images_picker;
+import progress;
 import utils;
 
 
+namespace Config
+{
+    export enum class ColorMode
+    {
+        Auto,           // mono when frames of capture have three identical channels
+        Mono,
+        Color,
+    };
+}
+
+
 namespace
 {
     std::string getCurrentTime()
@@ -64,6 +86,108 @@ namespace
         else
             return {};
     }
+
+    std::optional<Utils::CodecPolicy> readCodec(const boost::program_options::variable_value& codecValue, std::string_view option)
+    {
+        if (codecValue.empty())
+            return {};
+
+        const auto input = codecValue.as<std::string>();
+        const auto codec = Utils::readCodec(input);
+
+        if (codec.has_value() == false)
+            throw std::invalid_argument(std::format("Invalid value for --{} argument: {}. Expected png[:level[:strategy]], tiff[:compression] or bmp", option, input));
+
+        return codec;
+    }
+
+    // Job file lists inputs, one per line. Empty lines and lines starting with '#' are skipped.
+    std::vector<std::filesystem::path> readJobFile(const boost::program_options::variable_value& jobFile)
+    {
+        if (jobFile.empty())
+            return {};
+
+        const auto path = jobFile.as<std::string>();
+        std::ifstream file(path);
+
+        if (file.is_open() == false)
+            throw std::invalid_argument("Could not open job file: " + path);
+
+        std::vector<std::filesystem::path> inputs;
+        for (std::string line; std::getline(file, line);)
+        {
+            boost::trim(line);
+
+            if (line.empty() == false && line.front() != '#')
+                inputs.emplace_back(line);
+        }
+
+        return inputs;
+    }
+
+    std::optional<Progress::ReportFormat> readProgressFormat(const boost::program_options::variable_value& progressFormat)
+    {
+        const auto format = progressFormat.as<std::string>();
+
+        if (format == "human")
+            return Progress::ReportFormat::Human;
+        else if (format == "json")
+            return Progress::ReportFormat::Json;
+        else
+            return {};
+    }
+
+    std::optional<BayerPattern> readBayer(const boost::program_options::variable_value& bayerValue)
+    {
+        if (bayerValue.empty())
+            return {};
+
+        const auto input = bayerValue.as<std::string>();
+        const auto pattern = readBayerPattern(input);
+
+        if (pattern.has_value() == false)
+            throw std::invalid_argument("Invalid value for --bayer argument: " + input + ". Expected 'RGGB', 'BGGR', 'GRBG' or 'GBRG'");
+
+        return pattern;
+    }
+
+    std::optional<AlignmentMethod> readAlignmentMethod(const boost::program_options::variable_value& alignmentMethod)
+    {
+        const auto pickedMethod = alignmentMethod.as<std::string>();
+
+        if (pickedMethod == "ecc")
+            return AlignmentMethod::Ecc;
+        else if (pickedMethod == "stars")
+            return AlignmentMethod::Stars;
+        else
+            return {};
+    }
+
+    std::optional<Config::ColorMode> readColorMode(const boost::program_options::variable_value& colorMode)
+    {
+        const auto pickedMode = colorMode.as<std::string>();
+
+        if (pickedMode == "auto")
+            return Config::ColorMode::Auto;
+        else if (pickedMode == "mono")
+            return Config::ColorMode::Mono;
+        else if (pickedMode == "color")
+            return Config::ColorMode::Color;
+        else
+            return {};
+    }
+
+    std::optional<ChromaticAberrationMethod> readChromaMethod(const boost::program_options::variable_value& chromaMethod)
+    {
+        const auto pickedMethod = chromaMethod.as<std::string>();
+
+        if (pickedMethod == "homography")
+            return ChromaticAberrationMethod::Homography;
+        else if (pickedMethod == "shift")
+            return ChromaticAberrationMethod::Shift;
+        else
+            return {};
+    }
 }
 
 
@@ -73,21 +197,45 @@ namespace Config
     {
         const std::vector<std::filesystem::path> inputFiles;
         const std::filesystem::path wd;
+        const std::filesystem::path wdRoot;                 // --working-dir, wd is its subdirectory made for this run
         const std::optional<std::tuple<int, int, int, int>> crop;
         const std::optional<std::pair<int, int>> split;
+        const std::optional<std::pair<int, int>> slidingWindow;
+        const std::optional<Utils::CodecPolicy> intermediateCodec;
+        const std::optional<Utils::CodecPolicy> outputCodec;
         const PickerMethod pickerMethod;
+        const ChromaticAberrationMethod chromaMethod;
+        const AlignmentMethod alignmentMethod;
+        const ColorMode colorMode;
+        const std::optional<BayerPattern> bayer;
+        const std::optional<std::filesystem::path> daemonSpool;
+        const std::optional<std::filesystem::path> loadMetadata;       // working directory of previous run
         const size_t skip;
         const size_t stopAfter;
         const int backgroundThreshold;
         const int threads;
+        const int alignMaxIterations;
+        const int priority;
+        const std::chrono::milliseconds alignTimeBudget;
+        const size_t decodeThreads;
+        const size_t encodeThreads;
+        const size_t queueDepth;
+        const size_t parallelJobs;
+        const bool prefilter;
         const bool doObjectDetection;
+        const bool objectTracking;
         const bool collect;
         const bool debugSteps;
         const bool cleanup;
+        const bool inMemory;
+        const bool saveMetadata;
+        const std::chrono::milliseconds progressInterval;
+        const Progress::ReportFormat progressFormat;
     };
 
 
-    export Config readParams(int argc, char** argv)
+    // Arguments without program name
+    export Config readParams(const std::vector<std::string>& args)
     {
         namespace po = boost::program_options;
 
@@ -96,13 +244,39 @@ namespace Config
             ("help", "produce help message")
             ("working-dir", po::value<std::string>(), "set working directory")
             ("threads", po::value<int>()->default_value(0), "Set number of threads to use. 0 means all, negative values mean all + value. (For example -1 mean all but one)")
+            ("decode-threads", po::value<size_t>()->default_value(2), "Set number of threads reading images. They run alongside computation threads (see --threads)")
+            ("encode-threads", po::value<size_t>()->default_value(2), "Set number of threads writing images. They run alongside computation threads (see --threads)")
+            ("queue-depth", po::value<size_t>()->default_value(0), "Maximum number of images being read, processed or written at once. 0 means twice the number of threads")
             ("crop", po::value<std::string>(), "crop images to given size WidthxHeight. Additionaly an offset can be provided (WidthxHeight,dx,dy). Example: --crop 200x300 or --crop 1000x800,10,-5")
+            ("intermediate-codec", po::value<std::string>(), "Format of images passed between steps: png[:level[:strategy]], tiff[:compression] or bmp (16 bit images are scaled down to 8 bit). Example: --intermediate-codec png:1 or --intermediate-codec tiff (uncompressed)")
+            ("output-codec", po::value<std::string>(), "Format of final images (stacks and later steps), same syntax as for --intermediate-codec. Example: --output-codec png:9")
+            ("job-file", po::value<std::string>(), "Batch mode: file with list of inputs (one per line) to be processed. Can be combined with inputs given in command line")
+            ("parallel-jobs", po::value<size_t>()->default_value(2), "Batch and daemon modes: number of inputs (jobs) processed at the same time. Each input gets its own subdirectory in working directory")
+            ("daemon", po::value<std::string>(), "Daemon mode: keep running and process jobs dropped into given spool directory as *.job files. Each job file contains arguments (inputs and processing options) like a command line. "
+                                                "Write job under other name and rename it to *.job when complete. Thread, codec, memory, cleanup and progress options of daemon apply to all jobs, jobs setting them fail. "
+                                                "Job state and timings are written to status/<job>.json in spool directory")
+            ("priority", po::value<int>()->default_value(0), "Daemon mode: priority of job (set in job file). Jobs of higher priority are started first")
             ("split", po::value<std::string>(), "Split video into segments. Provide segment lenght and gap in frames as argument. Example: --split 120,40")
+            ("sliding-window", po::value<std::string>(), "Stack overlapping windows of frames. Provide window lenght and step in frames as argument. Example: --sliding-window 300,60")
             ("skip", po::value<size_t>()->default_value(0), "Skip n frames from the video begining. Example: --skip 60")
+            ("prefilter", "Reject frames without object, saturated, clouded and duplicated ones right after acquisition")
             ("disable-object-detection", "Disable object detection step")
+            ("object-tracking", "Detect object once and then track it over next frames. All frames are cropped to the same size around the object")
             ("use-best", po::value<std::string>()->default_value("median"), "Define how to choose best frames. Possible arguments: 'median', number (1÷100%)")
+            ("color-mode", po::value<std::string>()->default_value("auto"), "Define how colors of input are treated. Possible arguments: 'auto' (mono when sampled frames with content have identical channels), 'mono' (process as single channel images), 'color'")
+            ("bayer", po::value<std::string>(), "Input frames are raw mosaics of color camera with given color filter array: 'RGGB', 'BGGR', 'GRBG' or 'GBRG'. Frames are stacked raw and debayered afterwards. Detected automatically for SER files")
+            ("align-method", po::value<std::string>()->default_value("ecc"), "Define how frames are aligned. Possible arguments: 'ecc' (dense, for planets, Moon and Sun), 'stars' (stars matching, much faster for deep sky and wide field captures)")
+            ("align-max-iterations", po::value<int>()->default_value(5000), "Maximum number of ECC iterations when aligning a frame")
+            ("align-time-budget", po::value<double>()->default_value(0), "Maximum time in seconds spent on aligning a frame. Frames not aligned in time are rejected. 0 (default) means no limit")
+            ("chroma-method", po::value<std::string>()->default_value("homography"), "Define how color channels are registered when fixing chromatic aberration. Possible arguments: 'homography' (feature based), 'shift' (sub-pixel translation, much faster)")
             ("debug-steps", "Some steps will generate more output files for debugging purposes")
             ("cleanup", "Automatically remove processed files. Only final files will be left.")
+            ("save-metadata", "Save data computed for each frame (like size, object position, score and alignment) in metadata.bin file in working directory")
+            ("load-metadata", po::value<std::string>(), "Reuse frame scores saved with --save-metadata by previous run. Takes working directory of that run (with its time stamp). "
+                                                        "Rerun needs the same inputs and processing options")
+            ("in-memory", "Keep intermediate images in memory instead of working directory. Only final files are written to disk. Requires enough memory for all frames of a segment")
+            ("progress-interval", po::value<double>()->default_value(0), "Report progress, speed and ETA of running steps every N seconds. 0 (default) disables reports")
+            ("progress-format", po::value<std::string>()->default_value("human"), "Format of progress reports. Possible arguments: 'human', 'json' (one JSON object per line)")
             ("stop-after", po::value<size_t>()->default_value(0), "Stop processing after N steps. For 0 (default) process all")
             ("transparent-background", po::value<int>()->default_value(-1), "Post step: replace black regions with transparent after all steps (see --stop-after) are finished. Provide threshold as argument (0-255)")
             ("collect", "Post step: copy results from last step into final directory")
@@ -111,7 +285,7 @@ namespace Config
         po::variables_map vm;
         po::positional_options_description p;
         p.add("input-files", -1);
-        po::store(po::command_line_parser(argc, argv).options(desc).positional(p).run(), vm);
+        po::store(po::command_line_parser(args).options(desc).positional(p).run(), vm);
         po::notify(vm);
 
         if (vm.count("help"))
@@ -124,44 +298,137 @@ namespace Config
         if (vm.count("working-dir") == 0)
             throw std::invalid_argument("--working-dir option is required");
 
-        if (vm.count("input-files") == 0)
+        const auto daemonSpool = vm.count("daemon") > 0? std::optional<std::filesystem::path>(vm["daemon"].as<std::string>()): std::nullopt;
+        const auto loadMetadata = vm.count("load-metadata") > 0? std::optional<std::filesystem::path>(vm["load-metadata"].as<std::string>()): std::nullopt;
+
+        if (vm.count("input-files") == 0 && vm.count("job-file") == 0 && daemonSpool.has_value() == false)
             throw std::invalid_argument("Provide input files");
 
         const std::filesystem::path wd_option = vm["working-dir"].as<std::string>();
         const auto threads = vm["threads"].as<int>();
+        const auto decodeThreads = vm["decode-threads"].as<size_t>();
+        const auto encodeThreads = vm["encode-threads"].as<size_t>();
+        const auto queueDepth = vm["queue-depth"].as<size_t>();
         const auto crop = readCrop(vm["crop"]);
         const auto split = readSegments(vm["split"]);
+        const auto slidingWindow = readSegments(vm["sliding-window"]);
+        const auto intermediateCodec = readCodec(vm["intermediate-codec"], "intermediate-codec");
+        const auto outputCodec = readCodec(vm["output-codec"], "output-codec");
         const auto skip = vm["skip"].as<size_t>();
         const auto best = vm["use-best"];
+        const auto chroma = vm["chroma-method"];
+        const auto color = vm["color-mode"];
+        const auto bayer = readBayer(vm["bayer"]);
+        const auto alignment = vm["align-method"];
+        const auto alignMaxIterations = vm["align-max-iterations"].as<int>();
+        const auto alignTimeBudget = vm["align-time-budget"].as<double>();
+        const auto priority = vm["priority"].as<int>();
+        const bool prefilter = vm.count("prefilter") > 0;
         const bool doObjectDetection = vm.count("disable-object-detection") == 0;
-        const std::vector<std::string> inputFilesStr = vm["input-files"].as<std::vector<std::string>>();
+        const bool objectTracking = vm.count("object-tracking") > 0;
+        const auto inputFilesStr = vm.count("input-files") > 0? vm["input-files"].as<std::vector<std::string>>(): std::vector<std::string>{};
+        const auto jobFileInputs = readJobFile(vm["job-file"]);
+        const auto parallelJobs = vm["parallel-jobs"].as<size_t>();
         const bool debugSteps = vm.count("debug-steps") > 0;
         const bool cleanup = vm.count("cleanup") > 0;
+        const bool inMemory = vm.count("in-memory") > 0;
+        const bool saveMetadata = vm.count("save-metadata") > 0;
+        const auto progressInterval = vm["progress-interval"].as<double>();
+        const auto progressFormat = readProgressFormat(vm["progress-format"]);
         const auto stopAfter = vm["stop-after"].as<size_t>();
         const auto backgroundThreshold = vm["transparent-background"].as<int>();
         const auto collect = vm.count("collect") > 0;
 
-        const std::vector<std::filesystem::path> inputFiles(inputFilesStr.begin(), inputFilesStr.end());
+        std::vector<std::filesystem::path> inputFiles(inputFilesStr.begin(), inputFilesStr.end());
+        inputFiles.insert(inputFiles.end(), jobFileInputs.begin(), jobFileInputs.end());
         const auto pickerMethod = readPickerMethod(best);
+        const auto chromaMethod = readChromaMethod(chroma);
+        const auto alignmentMethod = readAlignmentMethod(alignment);
+        const auto colorMode = readColorMode(color);
         const auto wd = wd_option / getCurrentTime();
 
+        if (inputFiles.empty() && daemonSpool.has_value() == false)
+            throw std::invalid_argument("Provide input files");
+
+        if (slidingWindow && (slidingWindow->first <= 0 || slidingWindow->second <= 0))
+            throw std::invalid_argument("--sliding-window requires positive window length and step");
+
+        if (slidingWindow && split)
+            throw std::invalid_argument("--sliding-window and --split cannot be used together");
+
+        if (parallelJobs == 0)
+            throw std::invalid_argument("--parallel-jobs requires positive value");
+
+        if (decodeThreads == 0 || encodeThreads == 0)
+            throw std::invalid_argument("--decode-threads and --encode-threads require positive values");
+
+        if (alignMaxIterations <= 0)
+            throw std::invalid_argument("--align-max-iterations requires positive value");
+
+        if (alignTimeBudget < 0)
+            throw std::invalid_argument("--align-time-budget requires non-negative value");
+
+        if (progressInterval < 0)
+            throw std::invalid_argument("--progress-interval requires non-negative value");
+
+        if (progressFormat.has_value() == false)
+            throw std::invalid_argument("Invalid value for --progress-format argument: " + vm["progress-format"].as<std::string>() + ". Expected 'human' or 'json'");
+
         if (pickerMethod.has_value() == false)
             throw std::invalid_argument("Invalid value for --use-best argument: " + best.as<std::string>() + ". Expected 'median' or % value 1÷100");
 
+        if (chromaMethod.has_value() == false)
+            throw std::invalid_argument("Invalid value for --chroma-method argument: " + chroma.as<std::string>() + ". Expected 'homography' or 'shift'");
+
+        if (alignmentMethod.has_value() == false)
+            throw std::invalid_argument("Invalid value for --align-method argument: " + alignment.as<std::string>() + ". Expected 'ecc' or 'stars'");
+
+        if (colorMode.has_value() == false)
+            throw std::invalid_argument("Invalid value for --color-mode argument: " + color.as<std::string>() + ". Expected 'auto', 'mono' or 'color'");
+
         return Config {
             .inputFiles = inputFiles,
             .wd = wd,
+            .wdRoot = wd_option,
             .crop = crop,
             .split = split,
+            .slidingWindow = slidingWindow,
+            .intermediateCodec = intermediateCodec,
+            .outputCodec = outputCodec,
             .pickerMethod = *pickerMethod,
+            .chromaMethod = *chromaMethod,
+            .alignmentMethod = *alignmentMethod,
+            .colorMode = *colorMode,
+            .bayer = bayer,
+            .daemonSpool = daemonSpool,
+            .loadMetadata = loadMetadata,
             .skip = skip,
             .stopAfter = stopAfter,
             .backgroundThreshold = backgroundThreshold,
             .threads = threads,
+            .alignMaxIterations = alignMaxIterations,
+            .priority = priority,
+            .alignTimeBudget = std::chrono::milliseconds(static_cast<long long>(alignTimeBudget * 1000)),
+            .decodeThreads = decodeThreads,
+            .encodeThreads = encodeThreads,
+            .queueDepth = queueDepth,
+            .parallelJobs = parallelJobs,
+            .prefilter = prefilter,
             .doObjectDetection = doObjectDetection,
+            .objectTracking = objectTracking,
             .collect = collect,
             .debugSteps = debugSteps,
             .cleanup = cleanup,
+            .inMemory = inMemory,
+            .saveMetadata = saveMetadata,
+            .progressInterval = std::chrono::milliseconds(static_cast<long long>(progressInterval * 1000)),
+            .progressFormat = *progressFormat,
         };
     }
+
+
+    export Config readParams(int argc, char** argv)
+    {
+        return readParams(std::vector<std::string>(argv + std::min(argc, 1), argv + argc));
+    }
 }
@@ -2,12 +2,15 @@
 module;
 
 #include <filesystem>
+#include <format>
 #include <functional>
 #include <span>
 #include <vector>
+#include <spdlog/spdlog.h>
 
 export module execution_plan_builder;
 import ifile_manager;
+import progress;
 import utils;
 
 
@@ -18,7 +21,7 @@ export using Operation = std::function<ImagesList(const Utils::WorkingDir &, Ima
 export class ExecutionPlanBuilder
 {
 public:
-    ExecutionPlanBuilder(const Utils::WorkingDir& wd, const IFileManager& fileManager, size_t maxSteps = std::numeric_limits<size_t>::max())
+    ExecutionPlanBuilder(const Utils::WorkingDir& wd, IFileManager& fileManager, size_t maxSteps = std::numeric_limits<size_t>::max())
         : m_wd(wd)
         , m_fileManager(fileManager)
         , m_maxSteps(maxSteps == 0? std::numeric_limits<size_t>::max(): maxSteps)
@@ -70,10 +73,21 @@ public:
             const auto& subdir = std::get<2>(op);
             const auto wd = m_wd.getSubDir(subdir);
 
-            imagesList = Utils::measureTimeWithMessage(name, func, wd, imagesList);
+            // results of previous step can be released as soon as they are consumed by this one
+            if (previousWorkingDir)
+                m_fileManager.consumable(imagesList);
+
+            const Progress::StepScope progress(std::format("{}/{}", m_wd.path().filename().string(), subdir), imagesList.size(), wd.path());
+
+            // step name and number of processed images let tools calculate throughput of each step
+            spdlog::info(name);
+            auto [time, result] = Utils::measureTime(func, wd, imagesList);
+            spdlog::info("Execution time: {}ms (step: {}, images: {})", time, subdir, imagesList.size());
+
+            imagesList = std::move(result);
 
             if (previousWorkingDir)
-                m_fileManager.remove(*previousWorkingDir);
+                m_fileManager.remove(previousWorkingDir->path());
 
             previousWorkingDir = wd;
         };
@@ -98,6 +112,6 @@ private:
     std::vector<Op> m_ops;
     std::vector<Op> m_postOps;
     Utils::WorkingDir m_wd;
-    const IFileManager& m_fileManager;
+    IFileManager& m_fileManager;
     const size_t m_maxSteps;
 };
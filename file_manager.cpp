@@ -1,28 +1,109 @@
-
 module;
 
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <mutex>
 #include <set>
 #include <span>
+#include <thread>
+#include <spdlog/spdlog.h>
 
 export module file_manager;
 import ifile_manager;
 import utils;
 
 
+// Removes files in background thread, so removal does not block processing
 export class FileManager: public IFileManager
 {
 public:
-    FileManager(bool doRemoval) : m_remove(doRemoval) {}
+    FileManager(bool doRemoval) : m_remove(doRemoval)
+    {
+        if (m_remove)
+            m_remover = std::jthread([this](std::stop_token stop)
+            {
+                removeFiles(stop);
+            });
+    }
+
+    FileManager(const FileManager &) = delete;
+    FileManager& operator=(const FileManager &) = delete;
 
-    void remove(const Utils::WorkingDir& wd) const override
+    ~FileManager()
+    {
+        // remove everything which was scheduled before leaving
+        if (m_remover.joinable())
+        {
+            {
+                std::lock_guard lock(m_queueMutex);
+                m_remover.request_stop();
+            }
+
+            m_removeRequested.notify_one();
+            m_remover.join();
+        }
+    }
+
+    void remove(const std::filesystem::path& dir) override
     {
         if (m_remove == false)
             return;
 
-        std::filesystem::remove_all(wd.path());
+        Utils::forgetConsumableFiles(dir);
+        scheduleRemoval(dir);
+    }
+
+    void consumable(std::span<const std::filesystem::path> files) override
+    {
+        if (m_remove == false)
+            return;
+
+        Utils::addConsumableFiles(files, [this](const std::filesystem::path& file)
+        {
+            scheduleRemoval(file);
+        });
     }
 
 private:
+    std::jthread m_remover;
+    std::mutex m_queueMutex;
+    std::condition_variable m_removeRequested;
+    std::deque<std::filesystem::path> m_toRemove;
     const bool m_remove;
+
+    void scheduleRemoval(const std::filesystem::path& path)
+    {
+        {
+            std::lock_guard lock(m_queueMutex);
+            m_toRemove.push_back(path);
+        }
+
+        m_removeRequested.notify_one();
+    }
+
+    void removeFiles(std::stop_token stop)
+    {
+        while (true)
+        {
+            std::unique_lock lock(m_queueMutex);
+            m_removeRequested.wait(lock, [&]
+            {
+                return m_toRemove.empty() == false || stop.stop_requested();
+            });
+
+            if (m_toRemove.empty())
+                break;                  // stop requested and nothing left
+
+            const auto path = m_toRemove.front();
+            m_toRemove.pop_front();
+            lock.unlock();
+
+            std::error_code ec;
+            std::filesystem::remove_all(path, ec);
+
+            if (ec)
+                spdlog::warn("Could not remove {}: {}", path.string(), ec.message());
+        }
+    }
 };
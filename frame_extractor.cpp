@@ -1,18 +1,24 @@
 
 module;
 
+#include <atomic>
+#include <chrono>
 #include <filesystem>
 #include <format>
+#include <functional>
+#include <semaphore>
+#include <stdexcept>
 #include <opencv2/opencv.hpp>
-#include <omp.h>
 #include <spdlog/spdlog.h>
 
 export module frame_extractor;
+import frame_metadata;
+import progress;
 import utils;
 
 namespace
 {
-    std::vector<std::filesystem::path> extractFrames(const std::filesystem::path& file, const std::filesystem::path& dir, size_t firstFrame, size_t lastFrame)
+    std::vector<std::filesystem::path> extractFrames(const std::filesystem::path& file, const std::filesystem::path& dir, size_t firstFrame, size_t lastFrame, const Utils::FrameTransformFactory& transformFactory, const Progress::Counter& progress)
     {
         assert(lastFrame >= firstFrame);
 
@@ -25,6 +31,9 @@ namespace
         std::vector<std::filesystem::path> paths;
         paths.reserve(static_cast<size_t>(count));
 
+        const auto transform = transformFactory? transformFactory(): Utils::FrameTransform{};
+        const auto metadata = frameMetadata(dir);
+
         cv::VideoCapture video(file.string(), cv::CAP_FFMPEG);
         if (video.isOpened())
         {
@@ -35,9 +44,16 @@ namespace
                 cv::Mat frameMat;
                 video >> frameMat;
 
+                const double timestamp = video.get(cv::CAP_PROP_POS_MSEC);
                 const std::filesystem::path path = dir / std::format("{}-{}.png", fileName, frame);
-                cv::imwrite(path.string(), frameMat);
-                paths.push_back(path);
+                paths.push_back(Utils::writeImage(path, transform? transform(frameMat): frameMat));
+                progress.advance();
+
+                updateFrameMetadata(metadata, paths.back(), [&](FrameRecord& record)
+                {
+                    record.size = frameMat.size();
+                    record.timestamp = timestamp;
+                });
             }
         }
 
@@ -64,43 +80,150 @@ export size_t videoFrames(const std::filesystem::path& file)
 }
 
 
-export std::vector<std::filesystem::path> extractFrames(const std::filesystem::path& dir, std::span<const std::filesystem::path> files, size_t firstFrame, size_t lastFrame)
+export cv::Mat videoFrame(const std::filesystem::path& file, size_t frame)
+{
+    cv::Mat frameMat;
+
+    cv::VideoCapture video(file.string(), cv::CAP_FFMPEG);
+    if (video.isOpened())
+    {
+        video.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(frame));
+        video >> frameMat;
+    }
+
+    return frameMat;
+}
+
+
+export std::vector<std::filesystem::path> extractFrames(const std::filesystem::path& dir, std::span<const std::filesystem::path> files, size_t firstFrame, size_t lastFrame, const Utils::FrameTransformFactory& transform = {})
 {
     const auto file = files.front();
     const auto frames = lastFrame - firstFrame;
 
-    std::vector<std::pair<size_t, size_t>> segments;
-    std::vector<std::filesystem::path> paths;
+    // split frames among threads. It would be nice to use regular forEach for each frame but each thread needs to get
+    // continous region to work with (seeking is expensive).
+    const auto segments = Utils::split({firstFrame, lastFrame}, Utils::threads());
+    std::vector<std::filesystem::path> paths(frames);
+
+    const auto progress = Progress::counter(dir);
+    progress.setTotal(frames);
 
-    // split frames among threads. It would be nice to ure regular 'parallel for' but each thread needs to get
-    // continous region to work with.
-    #pragma omp parallel
+    Utils::forEach(segments, [&](const size_t segment)
     {
-        const auto threads = static_cast<size_t>(omp_get_num_threads());
+        const auto& [segmentFirstFrame, segmentLastFrame] = segments[segment];
+
+        spdlog::debug("Segment #{} got frames {} - {} ({} frames)", segment, segmentFirstFrame, segmentLastFrame - 1, segmentLastFrame - segmentFirstFrame);
+
+        const auto segment_paths = extractFrames(file, dir, segmentFirstFrame, segmentLastFrame, transform, progress);
+
+        for(size_t out_f = segmentFirstFrame, in_f = 0; out_f < segmentLastFrame; out_f++, in_f++)
+            paths[out_f - firstFrame] = segment_paths[in_f];
+    });
 
-        #pragma omp master
+    return paths;
+}
+
+
+// Decode video once and distribute its frames among segments (ascending, non overlapping ranges of frames).
+// Frames between segments are skipped without being decoded. Frames of each segment are written to its directory
+// and 'segmentReady' is called (from any thread) with segment's index and frames as soon as all of them are written.
+export void extractSegments(const std::filesystem::path& file,
+                            std::span<const std::pair<size_t, size_t>> segments,
+                            std::span<const std::filesystem::path> dirs,
+                            const Utils::FrameTransformFactory& transformFactory,
+                            const std::function<void(size_t, std::vector<std::filesystem::path>)>& segmentReady)
+{
+    assert(segments.size() == dirs.size());
+
+    cv::VideoCapture video(file.string(), cv::CAP_FFMPEG);
+    if (video.isOpened() == false)
+        throw std::runtime_error("Could not open video file " + file.string());
+
+    const auto fileName = file.filename().string();
+
+    std::vector<std::vector<std::filesystem::path>> paths(segments.size());
+    std::vector<std::atomic<size_t>> remaining(segments.size());
+
+    size_t totalFrames = 0;
+    for (const auto& [firstFrame, lastFrame]: segments)
+        totalFrames += lastFrame - firstFrame;
+
+    const Progress::StepScope progress(fileName + " decoding", totalFrames);
+    const auto counter = progress.counter();
+
+    const auto queueDepth = Utils::pipelineOptions().queueDepth > 0? Utils::pipelineOptions().queueDepth: 2 * Utils::threads();
+    std::counting_semaphore<> slots(static_cast<std::ptrdiff_t>(queueDepth));
+    Utils::TaskGroup group;
+
+    // wait for free slot without helping with other tasks: one of them could be processing of a whole segment,
+    // which would stall decoding. Slots are released by encoding tasks, which run in their own pool, so decoding
+    // needs no thread of the global pool to progress. Jobs calling it run in their own threads (see processBatch, runDaemon).
+    auto acquireSlot = [&]
+    {
+        while (group.cancelled() == false)
+            if (slots.try_acquire_for(std::chrono::milliseconds(10)))
+                return true;
+
+        return false;
+    };
+
+    size_t position = 0;
+    for (size_t segment = 0; segment < segments.size() && group.cancelled() == false; segment++)
+    {
+        const auto [firstFrame, lastFrame] = segments[segment];
+        assert(firstFrame >= position && lastFrame >= firstFrame);
+
+        paths[segment].resize(lastFrame - firstFrame);
+        remaining[segment] = lastFrame - firstFrame;
+
+        if (firstFrame == lastFrame)
         {
-            segments = Utils::split({firstFrame, lastFrame}, threads);
-            paths.resize(frames);
+            segmentReady(segment, {});
+            continue;
         }
-        #pragma omp barrier
 
-        const auto thread = static_cast<size_t>(omp_get_thread_num());
+        for (; position < firstFrame; position++)
+            video.grab();
+
+        // frames of segment are continous, so each segment gets its own transform
+        const auto transform = transformFactory? transformFactory(): Utils::FrameTransform{};
+        const auto metadata = frameMetadata(dirs[segment]);
 
-        if (thread < segments.size())
+        for (size_t frame = firstFrame; frame < lastFrame; frame++, position++)
         {
-            const auto& [threadFirstFrame, threadLastFrame] = segments[thread];
+            cv::Mat frameMat;
+            video >> frameMat;
 
-            spdlog::debug("Thread #{} got frames {} - {} ({} frames)", thread, threadFirstFrame, threadLastFrame - 1, threadLastFrame - threadFirstFrame);
+            if (frameMat.empty())
+                throw std::runtime_error(std::format("Could not read frame {} of {}", frame, file.string()));
 
-            const auto thread_paths = extractFrames(file, dir, threadFirstFrame, threadLastFrame);
+            const cv::Mat image = transform? transform(frameMat): frameMat;
+            const cv::Size frameSize = frameMat.size();
+            const double timestamp = video.get(cv::CAP_PROP_POS_MSEC);
 
-            for(size_t out_f = threadFirstFrame, in_f = 0; out_f < threadLastFrame; out_f++, in_f++)
-                paths[out_f - firstFrame] = thread_paths[in_f];
+            if (acquireSlot() == false)
+                break;
+
+            group.run(Utils::encodePool(), [&, segment, frame, image, frameSize, timestamp, metadata]
+            {
+                const std::filesystem::path path = dirs[segment] / std::format("{}-{}.png", fileName, frame);
+                const auto imagePath = Utils::writeImage(path, image);
+                slots.release();
+                counter.advance();
+
+                updateFrameMetadata(metadata, imagePath, [&](FrameRecord& record)
+                {
+                    record.size = frameSize;
+                    record.timestamp = timestamp;
+                });
+
+                paths[segment][frame - segments[segment].first] = imagePath;
+
+                if (--remaining[segment] == 0)
+                    segmentReady(segment, std::move(paths[segment]));
+            });
         }
-        else
-            spdlog::warn("Thread {} has nothing to do", thread);
     }
 
-    return paths;
+    group.wait();
 }
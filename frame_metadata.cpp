@@ -0,0 +1,425 @@
+
+module;
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+export module frame_metadata;
+import bayer;
+
+
+export enum class FrameRejection
+{
+    Empty = 1,          // no object found
+    Clipped,            // object is saturated
+    Clouded,            // object much darker than in other frames
+    Duplicate,          // the same as previous frame
+    Unaligned,          // alignment failed or did not converge in time
+};
+
+
+export enum class AlignmentStatus
+{
+    Converged = 1,      // correlation stopped improving
+    IterationLimit,     // iterations budget used up, transformation is still used
+    TimeLimit,          // time budget used up
+    Failed,             // ECC failed (like for uncorrelated images)
+};
+
+
+// Everything known about a single frame. Fields are filled by steps which compute them.
+export struct FrameRecord
+{
+    std::optional<cv::Size> size;                   // size of acquired frame
+    std::optional<double> timestamp;                // position of frame in capture [ms]
+    std::optional<cv::Rect> object;                 // main object's bounding box in acquired frame
+    std::optional<cv::Matx33d> redTransform;        // chromatic aberration: transformation of red channel to green one
+    std::optional<cv::Matx33d> blueTransform;       // chromatic aberration: transformation of blue channel to green one
+    std::optional<FrameRejection> rejection;        // reason of rejection by prefilter
+    std::optional<double> score;                    // quality of frame (see pickImages)
+    std::optional<cv::Matx33d> transform;           // alignment: transformation of reference frame into this one
+    std::optional<AlignmentStatus> alignmentStatus; // alignment: how search for transformation ended
+    std::optional<double> alignmentIterations;      // alignment: ECC iterations made
+    std::optional<double> alignmentCorrelation;     // alignment: final ECC correlation coefficient
+};
+
+
+namespace
+{
+    // Each column is stored as 'width' doubles per frame
+    struct Column
+    {
+        std::string name;
+        size_t width;
+        std::function<std::optional<std::vector<double>>(const FrameRecord &)> get;
+        std::function<void(FrameRecord &, std::span<const double>)> set;
+    };
+
+    std::vector<double> toValues(double value)            { return {value}; }
+    std::vector<double> toValues(const cv::Size& size)    { return {static_cast<double>(size.width), static_cast<double>(size.height)}; }
+    std::vector<double> toValues(const cv::Rect& rect)    { return {static_cast<double>(rect.x), static_cast<double>(rect.y), static_cast<double>(rect.width), static_cast<double>(rect.height)}; }
+    std::vector<double> toValues(const cv::Matx33d& m)    { return std::vector<double>(m.val, m.val + 9); }
+    std::vector<double> toValues(FrameRejection r)        { return {static_cast<double>(r)}; }
+    std::vector<double> toValues(AlignmentStatus s)       { return {static_cast<double>(s)}; }
+
+    void fromValues(std::span<const double> v, double& value)       { value = v[0]; }
+    void fromValues(std::span<const double> v, cv::Size& size)      { size = cv::Size(static_cast<int>(v[0]), static_cast<int>(v[1])); }
+    void fromValues(std::span<const double> v, cv::Rect& rect)      { rect = cv::Rect(static_cast<int>(v[0]), static_cast<int>(v[1]), static_cast<int>(v[2]), static_cast<int>(v[3])); }
+    void fromValues(std::span<const double> v, cv::Matx33d& m)      { std::copy_n(v.begin(), 9, m.val); }
+    void fromValues(std::span<const double> v, FrameRejection& r)   { r = static_cast<FrameRejection>(static_cast<int>(v[0])); }
+    void fromValues(std::span<const double> v, AlignmentStatus& s)  { s = static_cast<AlignmentStatus>(static_cast<int>(v[0])); }
+
+    template<typename T>
+    Column column(std::string name, size_t width, std::optional<T> FrameRecord::* member)
+    {
+        return Column{
+            .name = std::move(name),
+            .width = width,
+            .get = [member](const FrameRecord& record) -> std::optional<std::vector<double>>
+            {
+                const auto& value = record.*member;
+                if (value.has_value())
+                    return toValues(*value);
+                else
+                    return {};
+            },
+            .set = [member](FrameRecord& record, std::span<const double> values)
+            {
+                T value;
+                fromValues(values, value);
+                record.*member = value;
+            },
+        };
+    }
+
+    const std::vector<Column>& columns()
+    {
+        static const std::vector<Column> columns = {
+            column("size", 2, &FrameRecord::size),
+            column("timestamp", 1, &FrameRecord::timestamp),
+            column("object", 4, &FrameRecord::object),
+            column("red_transform", 9, &FrameRecord::redTransform),
+            column("blue_transform", 9, &FrameRecord::blueTransform),
+            column("rejection", 1, &FrameRecord::rejection),
+            column("score", 1, &FrameRecord::score),
+            column("transform", 9, &FrameRecord::transform),
+            column("alignment_status", 1, &FrameRecord::alignmentStatus),
+            column("alignment_iterations", 1, &FrameRecord::alignmentIterations),
+            column("alignment_correlation", 1, &FrameRecord::alignmentCorrelation),
+        };
+
+        return columns;
+    }
+
+    constexpr std::array<char, 4> magic = {'A', 'S', 'F', 'M'};
+    constexpr std::uint32_t version = 1;
+
+    template<typename T>
+    void write(std::ostream& stream, const T& value)
+    {
+        stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    T read(std::istream& stream)
+    {
+        T value;
+        stream.read(reinterpret_cast<char *>(&value), sizeof(T));
+
+        if (!stream)
+            throw std::runtime_error("Unexpected end of metadata file");
+
+        return value;
+    }
+
+    void writeString(std::ostream& stream, const std::string& str)
+    {
+        write(stream, static_cast<std::uint32_t>(str.size()));
+        stream.write(str.data(), static_cast<std::streamsize>(str.size()));
+    }
+
+    std::string readString(std::istream& stream)
+    {
+        std::string str(read<std::uint32_t>(stream), '\0');
+        stream.read(str.data(), static_cast<std::streamsize>(str.size()));
+
+        if (!stream)
+            throw std::runtime_error("Unexpected end of metadata file");
+
+        return str;
+    }
+}
+
+
+// Per-frame data computed by steps, keyed by frame id (image's file name without extension).
+// Stored as a columnar binary file (host byte order), so single columns can be read without parsing whole records.
+export class FrameMetadata
+{
+public:
+    FrameMetadata() = default;
+
+    FrameMetadata(const FrameMetadata &) = delete;
+    FrameMetadata& operator=(const FrameMetadata &) = delete;
+
+    static std::string frameId(const std::filesystem::path& image)
+    {
+        return image.stem().string();
+    }
+
+    void update(const std::string& frame, const std::function<void(FrameRecord &)>& update)
+    {
+        std::lock_guard lock(m_mutex);
+        update(m_records[frame]);
+    }
+
+    std::optional<FrameRecord> find(const std::string& frame) const
+    {
+        std::lock_guard lock(m_mutex);
+
+        const auto it = m_records.find(frame);
+        if (it == m_records.end())
+            return {};
+        else
+            return it->second;
+    }
+
+    std::map<std::string, FrameRecord> records() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_records;
+    }
+
+    // Frames of raw captures are color filter array mosaics
+    void setBayerPattern(BayerPattern pattern)
+    {
+        std::lock_guard lock(m_mutex);
+        m_bayerPattern = pattern;
+    }
+
+    std::optional<BayerPattern> bayerPattern() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_bayerPattern;
+    }
+
+    // Layout: magic, version, frames count, frame ids, columns count and for each column:
+    // name, width (doubles per frame), presence flag of each frame, values of each frame
+    void save(const std::filesystem::path& path) const
+    {
+        std::lock_guard lock(m_mutex);
+
+        std::ofstream file(path, std::ios::binary);
+        if (file.is_open() == false)
+            throw std::runtime_error("Could not open " + path.string() + " for writing");
+
+        file.write(magic.data(), magic.size());
+        write(file, version);
+        write(file, static_cast<std::uint64_t>(m_records.size()));
+
+        for (const auto& [frame, record]: m_records)
+            writeString(file, frame);
+
+        write(file, static_cast<std::uint32_t>(columns().size()));
+
+        for (const auto& column: columns())
+        {
+            writeString(file, column.name);
+            write(file, static_cast<std::uint32_t>(column.width));
+
+            std::vector<char> present;
+            std::vector<double> values;
+            present.reserve(m_records.size());
+            values.reserve(m_records.size() * column.width);
+
+            for (const auto& [frame, record]: m_records)
+            {
+                const auto value = column.get(record);
+
+                present.push_back(value.has_value()? 1: 0);
+                if (value)
+                    values.insert(values.end(), value->begin(), value->end());
+                else
+                    values.resize(values.size() + column.width, 0.0);
+            }
+
+            file.write(present.data(), static_cast<std::streamsize>(present.size()));
+            file.write(reinterpret_cast<const char *>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(double)));
+        }
+
+        if (!file)
+            throw std::runtime_error("Could not write " + path.string());
+    }
+
+    // Unknown columns are skipped
+    void load(const std::filesystem::path& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (file.is_open() == false)
+            throw std::runtime_error("Could not open " + path.string());
+
+        std::array<char, 4> fileMagic;
+        file.read(fileMagic.data(), fileMagic.size());
+
+        if (!file || fileMagic != magic || read<std::uint32_t>(file) != version)
+            throw std::runtime_error(path.string() + " is not a supported metadata file");
+
+        const auto frames = read<std::uint64_t>(file);
+
+        std::vector<std::string> ids;
+        ids.reserve(frames);
+
+        for (std::uint64_t i = 0; i < frames; i++)
+            ids.push_back(readString(file));
+
+        std::lock_guard lock(m_mutex);
+
+        const auto columnsCount = read<std::uint32_t>(file);
+        for (std::uint32_t c = 0; c < columnsCount; c++)
+        {
+            const auto name = readString(file);
+            const auto width = read<std::uint32_t>(file);
+
+            std::vector<char> present(frames);
+            std::vector<double> values(frames * width);
+            file.read(present.data(), static_cast<std::streamsize>(present.size()));
+            file.read(reinterpret_cast<char *>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(double)));
+
+            if (!file)
+                throw std::runtime_error("Unexpected end of metadata file");
+
+            const auto column = std::ranges::find(columns(), name, &Column::name);
+            if (column == columns().end() || column->width != width)
+                continue;
+
+            for (std::uint64_t i = 0; i < frames; i++)
+                if (present[i])
+                    column->set(m_records[ids[i]], std::span(values).subspan(i * width, width));
+        }
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::map<std::string, FrameRecord> m_records;
+    std::optional<BayerPattern> m_bayerPattern;
+};
+
+
+namespace
+{
+    struct Registry
+    {
+        std::shared_mutex mutex;
+        std::map<std::filesystem::path, std::shared_ptr<FrameMetadata>> metadata;
+    };
+
+    Registry& registry()
+    {
+        static Registry registry;
+        return registry;
+    }
+}
+
+
+// Metadata for frames processed in given working directory (and its subdirectories)
+export void registerFrameMetadata(const std::filesystem::path& dir, std::shared_ptr<FrameMetadata> metadata)
+{
+    auto& r = registry();
+    std::unique_lock lock(r.mutex);
+    r.metadata[dir] = std::move(metadata);
+}
+
+export void unregisterFrameMetadata(const std::filesystem::path& dir)
+{
+    auto& r = registry();
+    std::unique_lock lock(r.mutex);
+    r.metadata.erase(dir);
+}
+
+// Metadata registered for the most nested directory containing given path. Null if there is none.
+// Steps look it up once for their directory, not for each frame.
+export std::shared_ptr<FrameMetadata> frameMetadata(const std::filesystem::path& path)
+{
+    auto& r = registry();
+    std::shared_lock lock(r.mutex);
+
+    for (auto dir = path; dir.empty() == false; dir = dir.parent_path())
+    {
+        if (const auto it = r.metadata.find(dir); it != r.metadata.end())
+            return it->second;
+
+        if (dir == dir.parent_path())
+            break;
+    }
+
+    return {};
+}
+
+// Registers metadata for the lifetime of the object
+export class FrameMetadataRegistration
+{
+public:
+    FrameMetadataRegistration(const std::filesystem::path& dir, std::shared_ptr<FrameMetadata> metadata)
+        : m_dir(dir)
+    {
+        registerFrameMetadata(m_dir, std::move(metadata));
+    }
+
+    FrameMetadataRegistration(const FrameMetadataRegistration &) = delete;
+    FrameMetadataRegistration& operator=(const FrameMetadataRegistration &) = delete;
+
+    ~FrameMetadataRegistration()
+    {
+        unregisterFrameMetadata(m_dir);
+    }
+
+private:
+    const std::filesystem::path m_dir;
+};
+
+// Update record of frame stored in 'image'. Does nothing if there is no metadata.
+export void updateFrameMetadata(const std::shared_ptr<FrameMetadata>& metadata, const std::filesystem::path& image, const std::function<void(FrameRecord &)>& update)
+{
+    if (metadata)
+        metadata->update(FrameMetadata::frameId(image), update);
+}
+
+export void updateFrameMetadata(const std::filesystem::path& image, const std::function<void(FrameRecord &)>& update)
+{
+    updateFrameMetadata(frameMetadata(image), image, update);
+}
+
+export std::optional<FrameRecord> frameRecord(const std::shared_ptr<FrameMetadata>& metadata, const std::filesystem::path& image)
+{
+    if (metadata)
+        return metadata->find(FrameMetadata::frameId(image));
+    else
+        return {};
+}
+
+export std::optional<FrameRecord> frameRecord(const std::filesystem::path& image)
+{
+    return frameRecord(frameMetadata(image), image);
+}
+
+// Pattern of color filter array when image is a raw mosaic
+export std::optional<BayerPattern> bayerPattern(const std::filesystem::path& image)
+{
+    if (const auto metadata = frameMetadata(image))
+        return metadata->bayerPattern();
+    else
+        return {};
+}
@@ -1,17 +1,66 @@
-
 module;
 
 #include <filesystem>
 #include <span>
+#include <vector>
+#include <opencv2/opencv.hpp>
 
 
 export module ifile_manager;
 
-import utils;
 
+// Storage for working directories. Default implementation works on disk.
 export struct IFileManager
 {
     virtual ~IFileManager() = default;
 
-    virtual void remove(const Utils::WorkingDir& wd) const = 0;
+    // working directory of a step is not needed anymore
+    virtual void remove(const std::filesystem::path& dir) = 0;
+
+    // files are not needed anymore once they are read by next step
+    virtual void consumable(std::span<const std::filesystem::path> files) = 0;
+
+    virtual void create(const std::filesystem::path& dir)
+    {
+        std::filesystem::create_directories(dir);
+    }
+
+    virtual cv::Mat read(const std::filesystem::path& file, int flags)
+    {
+        return cv::imread(file.string(), flags);
+    }
+
+    virtual void write(const std::filesystem::path& file, const cv::Mat& image, const std::vector<int>& parameters)
+    {
+        cv::imwrite(file.string(), image, parameters);
+    }
+
+    virtual void copy(const std::filesystem::path& from, const std::filesystem::path& to)
+    {
+        std::filesystem::copy_file(from, to);
+    }
+
+    // Make file available under new path without copying its content.
+    // Hard link survives removal of the original file (like previous step's directory). Symbolic link is used when hard link
+    // cannot be created (like for files on other file systems). Falls back to copy when links are not available.
+    virtual void link(const std::filesystem::path& from, const std::filesystem::path& to)
+    {
+        std::error_code ec;
+        std::filesystem::create_hard_link(from, to, ec);
+
+        if (ec)
+        {
+            ec.clear();
+            std::filesystem::create_symlink(std::filesystem::absolute(from), to, ec);
+        }
+
+        if (ec)
+            copy(from, to);
+    }
+
+    // Make sure files are stored on disk. Returns paths to stored files.
+    virtual std::vector<std::filesystem::path> persist(std::span<const std::filesystem::path> files)
+    {
+        return {files.begin(), files.end()};
+    }
 };
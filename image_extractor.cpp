@@ -1,36 +1,113 @@
-
 module;
 
+#include <algorithm>
 #include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <ranges>
 #include <vector>
+#include <opencv2/opencv.hpp>
 
 export module image_extractor;
+import frame_metadata;
+import progress;
 import utils;
 
 
-auto collectImages(const std::filesystem::path& inputDir)
+namespace
 {
-    auto files =
-        std::filesystem::recursive_directory_iterator(inputDir) |
-        std::views::filter([](const std::filesystem::directory_entry &entry)
-        {
-            return entry.is_regular_file();
-        }) |
-        std::views::transform([](const std::filesystem::directory_entry &entry)
+    std::vector<std::filesystem::path> listImages(const std::filesystem::path& inputDir)
+    {
+        auto files =
+            std::filesystem::recursive_directory_iterator(inputDir) |
+            std::views::filter([](const std::filesystem::directory_entry &entry)
+            {
+                return entry.is_regular_file();
+            }) |
+            std::views::transform([](const std::filesystem::directory_entry &entry)
+            {
+                return entry.path();
+            });
+
+        auto images = files | std::ranges::to<std::vector>();
+
+        std::ranges::sort(images, [](const std::filesystem::path& lhs, const std::filesystem::path& rhs)
         {
-            return entry.path();
+            return Utils::naturalLess(lhs.string(), rhs.string());
         });
 
-    return files | std::ranges::to<std::vector>();
+        return images;
+    }
+
+    struct ListingsRegistry
+    {
+        std::mutex mutex;
+        std::map<std::filesystem::path, std::weak_ptr<const std::vector<std::filesystem::path>>> listings;
+    };
+
+    ListingsRegistry& listingsRegistry()
+    {
+        static ListingsRegistry registry;
+        return registry;
+    }
+
+    // Listing kept by a living DirectoryListing, or a fresh one
+    std::shared_ptr<const std::vector<std::filesystem::path>> collectImages(const std::filesystem::path& inputDir, bool keep = false)
+    {
+        auto& r = listingsRegistry();
+        std::lock_guard lock(r.mutex);
+
+        const auto key = std::filesystem::absolute(inputDir);
+        auto& listing = r.listings[key];
+
+        if (auto images = listing.lock())
+            return images;
+
+        auto images = std::make_shared<const std::vector<std::filesystem::path>>(listImages(inputDir));
+        if (keep)
+            listing = images;
+        else
+            r.listings.erase(key);
+
+        return images;
+    }
 }
 
+
+// Keeps listing of input directory while it is processed, so counting, reading of the first image and acquisition
+// of each segment scan it only once. Next processing lists directory again, as images could be added or removed meanwhile.
+export class DirectoryListing
+{
+public:
+    explicit DirectoryListing(const std::filesystem::path& inputDir)
+        : m_images(collectImages(inputDir, true))
+    {
+
+    }
+
+private:
+    const std::shared_ptr<const std::vector<std::filesystem::path>> m_images;
+};
+
+
 export size_t countImages(const std::filesystem::path& inputDir)
 {
-    return collectImages(inputDir).size();
+    return collectImages(inputDir)->size();
+}
+
+export cv::Mat directoryImage(const std::filesystem::path& inputDir, size_t image)
+{
+    const auto listing = collectImages(inputDir);
+    const auto& images = *listing;
+
+    if (image >= images.size())
+        throw std::out_of_range("image index > number of images");
+
+    return Utils::readImage(images[image]);
 }
 
-export std::vector<std::filesystem::path> collectImages(const std::filesystem::path& dir, std::span<const std::filesystem::path> files, size_t firstFrame, size_t lastFrame)
+export std::vector<std::filesystem::path> collectImages(const std::filesystem::path& dir, std::span<const std::filesystem::path> files, size_t firstFrame, size_t lastFrame, const Utils::FrameTransformFactory& transformFactory = {})
 {
     if (files.size() != 1)
         throw std::runtime_error("Unexpected number of input elements: " + std::to_string(files.size()));
@@ -40,14 +117,50 @@ export std::vector<std::filesystem::path> collectImages(const std::filesystem::p
     if (not std::filesystem::is_directory(input))
         throw std::runtime_error("Input path: " + input.string() + " is not a directory");
 
-    const auto images = collectImages(input);
+    const auto listing = collectImages(input);
+    const auto& images = *listing;
     const auto count = images.size();
 
     if (count < lastFrame)
         throw std::out_of_range("last frame > number of frames");
 
-    return Utils::processImages(std::ranges::subrange(images.begin() + firstFrame, images.begin() + lastFrame), dir, [](const auto& image)
+    const std::span<const std::filesystem::path> inputImages(images.begin() + firstFrame, images.begin() + lastFrame);
+
+    // nothing to be done with images - just refer to them
+    if (not transformFactory)
+        return Utils::linkFiles(inputImages, dir);
+
+    // transformation may be stateful, so give each thread a continous region of images
+    const auto segments = Utils::split({0, inputImages.size()}, Utils::threads());
+
+    // recursive listing may contain files with equal names from different subdirectories
+    const auto names = Utils::uniqueFileNames(inputImages);
+    std::vector<std::filesystem::path> paths(inputImages.size());
+
+    const auto progress = Progress::counter(dir);
+    progress.setTotal(inputImages.size());
+
+    const auto metadata = frameMetadata(dir);
+
+    Utils::forEach(segments, [&](const size_t s)
     {
-        return image;
+        const auto& [segmentFirst, segmentLast] = segments[s];
+        const auto transform = transformFactory();
+
+        for (size_t i = segmentFirst; i < segmentLast; i++)
+        {
+            const auto& imagePath = inputImages[i];
+            const cv::Mat image = Utils::readImage(imagePath);
+
+            paths[i] = Utils::writeImage(dir / names[i], transform(image));
+            progress.advance();
+
+            updateFrameMetadata(metadata, paths[i], [&](FrameRecord& record)
+            {
+                record.size = image.size();
+            });
+        }
     });
+
+    return paths;
 }
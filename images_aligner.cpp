@@ -1,13 +1,109 @@
 
 module;
 
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <format>
 #include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
 #include <vector>
 #include <opencv2/opencv.hpp>
+#include <spdlog/spdlog.h>
 
 export module images_aligner;
+import bayer;
+import frame_metadata;
+import progress;
+import star_matcher;
+import utils;
+
+
+export struct EccOptions
+{
+    int maxIterations = 5000;                       // per frame
+    std::chrono::milliseconds timeBudget{0};        // per frame, 0 means no limit
+    double eps = 5e-5;                              // correlation improvement below which ECC is considered converged
+};
+
+
+export struct EccResult
+{
+    cv::Mat transformation;                         // empty when ECC failed
+    AlignmentStatus status = AlignmentStatus::IterationLimit;
+    int iterations = 0;                             // upper bound: ECC does not report iterations it made, so limits of its rounds are summed
+    double correlation = 0.0;
+};
+
+
+// Homography of imageGray relative to referenceImageGray found by ECC.
+// ECC is run in short rounds, so time budget can be checked and convergence observed between them.
+export EccResult findTransformation(const cv::Mat& referenceImageGray, const cv::Mat& imageGray, const EccOptions& options = {})
+{
+    constexpr int roundIterations = 50;
+    const auto start = std::chrono::steady_clock::now();
+
+    EccResult result {
+        .transformation = cv::Mat::eye(3, 3, CV_32F),
+    };
+
+    double previousCorrelation = -1.0;
+
+    while (result.iterations < options.maxIterations)
+    {
+        const int iterations = std::min(roundIterations, options.maxIterations - result.iterations);
+        const cv::TermCriteria criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, iterations, options.eps);
+
+        try
+        {
+            // each round continues from transformation found by previous one
+            result.correlation = cv::findTransformECC(referenceImageGray, imageGray, result.transformation, cv::MOTION_HOMOGRAPHY, criteria);
+        }
+        catch (const cv::Exception &)
+        {
+            // thrown when ECC diverges, like for frames without common details
+            result.transformation.release();
+            result.status = AlignmentStatus::Failed;
+            return result;
+        }
+
+        result.iterations += iterations;
+
+        if (result.correlation - previousCorrelation < options.eps)
+        {
+            result.status = AlignmentStatus::Converged;
+            break;
+        }
+
+        previousCorrelation = result.correlation;
+
+        if (options.timeBudget.count() > 0 && std::chrono::steady_clock::now() - start >= options.timeBudget)
+        {
+            result.status = AlignmentStatus::TimeLimit;
+            break;
+        }
+    }
+
+    return result;
+}
+
+
+export enum class AlignmentMethod
+{
+    Ecc,                // dense, whole image (planets, Moon, Sun)
+    Stars,              // stars matched by triangles (deep sky, wide field)
+};
+
+
+export struct AlignmentOptions
+{
+    AlignmentMethod method = AlignmentMethod::Ecc;
+    EccOptions ecc;
+};
 
 
 namespace
@@ -18,6 +114,10 @@ namespace
 
         for(const auto& transformation: transformations)
         {
+            // rejected image
+            if (transformation.empty())
+                continue;
+
             cv::Rect2f cropped = imageSize;
 
             if (transformation.at<float>(0, 2) < 0)
@@ -49,106 +149,237 @@ namespace
         return cropSum;
     }
 
-    auto findTransformation(const cv::Mat& referenceImageGray, const cv::Mat& imageGray)
+    // ECC supports 8 bit and floating point images only
+    const cv::Mat& eccInput(const cv::Mat& gray, cv::Mat& buffer)
     {
-        const int number_of_iterations = 5000;
-        const double termination_eps = 5e-5;
-        const cv::TermCriteria criteria (cv::TermCriteria::COUNT + cv::TermCriteria::EPS, number_of_iterations, termination_eps);
+        if (gray.depth() == CV_8U)
+            return gray;
 
-        cv::Mat warp_matrix = cv::Mat::eye(3, 3, CV_32F);
-        cv::findTransformECC(referenceImageGray, imageGray, warp_matrix, cv::MOTION_HOMOGRAPHY, criteria);
+        gray.convertTo(buffer, CV_32F);
+        return buffer;
+    }
 
-        return warp_matrix;
+    // Raw mosaics are aligned using their half resolution luminance
+    cv::Mat readForAlignment(const std::filesystem::path& path, bool cfa)
+    {
+        const auto image = Utils::readImage(path);
+        return cfa? cfaLuma(image): image;
     }
 
-    std::pair<std::vector<cv::Mat>, cv::Size> calculateTransformations(const std::span<const std::filesystem::path> images)
+    // Transformation by ECC. Frames which failed or ran out of time are rejected.
+    std::optional<cv::Mat> eccTransformation(const cv::Mat& referenceImageGray, const cv::Mat& gray, const std::filesystem::path& path, const EccOptions& options, const std::shared_ptr<FrameMetadata>& metadata)
     {
-        const auto& first = images.front();
-        const auto referenceImage = cv::imread(first.string());
-        cv::Size minimalSize = referenceImage.size();
+        const cv::Mat& imageGray = eccInput(gray, Utils::threadBuffer("eccInput", gray.size(), CV_32FC1));
 
-        cv::Mat referenceImageGray;
-        cv::cvtColor(referenceImage, referenceImageGray, cv::COLOR_RGB2GRAY);
+        const auto result = findTransformation(referenceImageGray, imageGray, options);
+        const bool rejected = result.status == AlignmentStatus::Failed || result.status == AlignmentStatus::TimeLimit;
 
-        const cv::Rect firstImageSize(0, 0, referenceImage.size().width, referenceImage.size().height);
+        updateFrameMetadata(metadata, path, [&result, rejected](FrameRecord& record)
+        {
+            record.alignmentStatus = result.status;
+            record.alignmentIterations = result.iterations;
+            record.alignmentCorrelation = result.correlation;
 
-        // calculate required transformations
-        std::vector<cv::Mat> transformations(1, []{
-            cv::Mat mat = cv::Mat::eye(3, 3, CV_32F);
-            mat.at<float>(0, 0) = 1.;
-            mat.at<float>(1, 1) = 1.;
+            if (rejected)
+                record.rejection = FrameRejection::Unaligned;
+            else
+                record.transform = cv::Matx33d(result.transformation);
+        });
 
-            return mat;
-        }());  // insert empty transformation matrix for first image
+        if (rejected)
+        {
+            spdlog::debug("{} rejected: ECC {} after {} iterations", path.filename().string(), result.status == AlignmentStatus::Failed? "failed": "ran out of time", result.iterations);
+            return {};
+        }
 
-        const auto imagesCount = images.size();
-        transformations.resize(imagesCount);
+        return result.transformation;
+    }
 
-        #pragma omp parallel for
-        for (size_t i = 1; i < imagesCount; i++)
+    // Transformation by matching stars. Frames with too few matching stars are rejected.
+    std::optional<cv::Mat> starsTransformation(const StarField& referenceStars, const cv::Mat& gray, const std::filesystem::path& path, const std::shared_ptr<FrameMetadata>& metadata)
+    {
+        const auto match = matchStarFields(referenceStars, detectStarField(gray));
+
+        updateFrameMetadata(metadata, path, [&match](FrameRecord& record)
         {
-            const auto& next = images[i];
-            const auto image = cv::imread(next.string());
+            record.alignmentStatus = match? AlignmentStatus::Converged: AlignmentStatus::Failed;
+
+            if (match)
+                record.transform = cv::Matx33d(match->transformation);
+            else
+                record.rejection = FrameRejection::Unaligned;
+        });
+
+        if (match.has_value() == false)
+        {
+            spdlog::debug("{} rejected: stars do not match reference", path.filename().string());
+            return {};
+        }
 
-            cv::Mat imageGray;
-            cv::cvtColor(image, imageGray, cv::COLOR_RGB2GRAY);
+        return match->transformation;
+    }
+
+    // Transformations of images which could not be aligned are left empty
+    std::pair<std::vector<cv::Mat>, cv::Size> calculateTransformations(const std::span<const std::filesystem::path> images, size_t reference, bool cfa, const AlignmentOptions& options, const Progress::Counter& progress)
+    {
+        const auto referenceImage = readForAlignment(images[reference], cfa);
+        cv::Size minimalSize = referenceImage.size();
 
-            const auto transformation = findTransformation(referenceImageGray, imageGray);
+        cv::Mat referenceImageBuffer, referenceEccBuffer;
+        const cv::Mat& referenceGray = Utils::toGray(referenceImage, referenceImageBuffer, cv::COLOR_RGB2GRAY);
 
-            transformations[i] = transformation;
+        // reference is prepared once for all images
+        const bool useStars = options.method == AlignmentMethod::Stars;
+        const cv::Mat referenceImageGray = useStars? cv::Mat(): eccInput(referenceGray, referenceEccBuffer);
+        const StarField referenceStars = useStars? detectStarField(referenceGray): StarField{};
 
-            #pragma omp critical
+        if (useStars && referenceStars.triangles.empty())
+            throw std::runtime_error("Not enough stars found on reference image " + images[reference].filename().string());
+
+        // calculate required transformations
+        const auto imagesCount = images.size();
+        std::vector<cv::Mat> transformations(imagesCount);
+        transformations[reference] = cv::Mat::eye(3, 3, CV_32F);    // reference image does not need any transformations
+
+        std::mutex minimalSizeMutex;
+        const auto metadata = frameMetadata(images[reference]);
+
+        Utils::forEach(images, [&](const size_t i)
+        {
+            if (i == reference)
             {
-                minimalSize.width = std::min(minimalSize.width, image.size().width);
-                minimalSize.height = std::min(minimalSize.height, image.size().height);
+                progress.advance();
+                return;
             }
-        }
+
+            const auto& next = images[i];
+            const auto image = readForAlignment(next, cfa);
+
+            const cv::Mat& gray = Utils::toGray(image, Utils::threadBuffer("gray", image.size(), CV_MAKETYPE(image.depth(), 1)), cv::COLOR_RGB2GRAY);
+
+            const auto transformation = useStars?
+                starsTransformation(referenceStars, gray, next, metadata):
+                eccTransformation(referenceImageGray, gray, next, options.ecc, metadata);
+
+            progress.advance();
+
+            if (transformation.has_value() == false)
+                return;
+
+            transformations[i] = *transformation;
+
+            std::lock_guard lock(minimalSizeMutex);
+            minimalSize.width = std::min(minimalSize.width, image.size().width);
+            minimalSize.height = std::min(minimalSize.height, image.size().height);
+        });
 
         return {transformations, minimalSize};
     }
 }
 
 
-export std::vector<std::filesystem::path> alignImages(const std::filesystem::path& dir, std::span<const std::filesystem::path> images)
+export struct Alignment
+{
+    size_t reference;                           // index of image other images are aligned to
+    std::vector<cv::Mat> transformations;       // transformation of each image
+    cv::Rect crop;                              // region covered by all aligned images
+    bool cfa = false;                           // images are raw mosaics, transformations and crop apply to their half resolution planes
+
+    // false for images rejected by aligner
+    bool isAligned(size_t i) const
+    {
+        return transformations[i].empty() == false;
+    }
+};
+
+
+export Alignment calculateAlignment(std::span<const std::filesystem::path> images, size_t reference = 0, const AlignmentOptions& options = {}, const Progress::Counter& progress = {})
 {
     // TODO: replace with structure binding when supported by compilers
-    const std::pair transformationsAndSize = calculateTransformations(images);
-    const auto transformations = transformationsAndSize.first;
-    const auto minimalSize = transformationsAndSize.second;
-
-    const auto& first = images.front();
-    const auto referenceImage = cv::imread(first.string());
-    const cv::Rect firstImageSize(0, 0, minimalSize.width, minimalSize.height);
-    const auto targetRect = calculateCrop(firstImageSize, transformations);
+    const bool cfa = images.empty() == false && bayerPattern(images.front()).has_value();
+    const std::pair transformationsAndSize = calculateTransformations(images, reference, cfa, options, progress);
+    const auto& transformations = transformationsAndSize.first;
+    const auto& minimalSize = transformationsAndSize.second;
+
+    const cv::Rect imageSize(0, 0, minimalSize.width, minimalSize.height);
+
+    return Alignment{
+        .reference = reference,
+        .transformations = transformations,
+        .crop = calculateCrop(imageSize, transformations),
+        .cfa = cfa,
+    };
+}
+
+
+// Align i-th image. Returned image may be a thread buffer (see Utils::threadBuffer)
+export cv::Mat alignImage(const cv::Mat& image, const Alignment& alignment, size_t i)
+{
+    // each plane of mosaic is aligned separately, so colors of pixels are not mixed
+    if (alignment.cfa)
+    {
+        auto planes = splitCfa(image);
+
+        for (auto& plane: planes)
+        {
+            if (i != alignment.reference)
+                cv::warpPerspective(plane.clone(), plane, alignment.transformations[i], plane.size(), cv::INTER_LINEAR + cv::WARP_INVERSE_MAP);
+
+            plane = plane(alignment.crop);
+        }
+
+        return mergeCfa(planes);
+    }
+
+    cv::Mat imageAligned;
+    if (i == alignment.reference)
+        imageAligned = image;  // reference image does not need any transformations
+    else
+    {
+        imageAligned = Utils::threadBuffer("aligned", image.size(), image.type());
+        cv::warpPerspective(image, imageAligned, alignment.transformations[i], image.size(), cv::INTER_LINEAR + cv::WARP_INVERSE_MAP);
+    }
+
+    return imageAligned(alignment.crop);
+}
+
+
+// Images which could not be aligned are rejected (see FrameRejection::Unaligned)
+export std::vector<std::filesystem::path> alignImages(const std::filesystem::path& dir, std::span<const std::filesystem::path> images, const AlignmentOptions& options = {})
+{
     const auto imagesCount = images.size();
 
+    // each image is read twice: to find its transformation and to align it
+    const auto progress = Progress::counter(dir);
+    progress.setTotal(2 * imagesCount);
+
+    const auto alignment = calculateAlignment(images, 0, options, progress);
+
     std::vector<std::filesystem::path> alignedImages;
     alignedImages.resize(imagesCount);
 
-    #pragma omp parallel for
-    for (size_t i = 0; i < imagesCount; i++)
+    Utils::forEach(images, [&](const size_t i)
     {
+        if (alignment.isAligned(i) == false)
+        {
+            progress.advance();
+            return;
+        }
+
         const auto& imagePath = images[i];
         const auto imageFilename = imagePath.filename().string();
 
-        const auto image = cv::imread(imagePath.string());
-
-        // align
-        cv::Mat imageAligned;
-        if (i == 0)
-            imageAligned = image;  // reference image does not need any transformations
-        else
-            cv::warpPerspective(image, imageAligned, transformations[i], image.size(), cv::INTER_LINEAR + cv::WARP_INVERSE_MAP);
-
-        // apply crop
-        const auto croppedNextImg = imageAligned(targetRect);
+        const auto image = Utils::readImage(imagePath);
+        const auto alignedImage = alignImage(image, alignment, i);
 
         // save
-        const auto path = dir / imageFilename;
-        cv::imwrite(path.string(), croppedNextImg);
+        alignedImages[i] = Utils::writeImage(dir / imageFilename, alignedImage);
+        progress.advance();
+    });
 
-        alignedImages[i] = path;
-    }
+    const auto rejected = std::erase_if(alignedImages, [](const std::filesystem::path& path) { return path.empty(); });
+    if (rejected > 0)
+        spdlog::info("{} of {} frames could not be aligned and were rejected", rejected, imagesCount);
 
     return alignedImages;
 }
@@ -2,37 +2,50 @@
 module;
 
 #include <filesystem>
+#include <optional>
 #include <vector>
 
 #include <opencv2/opencv.hpp>
 
 export module images_cropper;
 
+import bayer;
+import frame_metadata;
 import utils;
 
 
-export std::vector<std::filesystem::path> cropImages(const std::filesystem::path& wd, std::span<const std::filesystem::path> images, const std::tuple<int, int, int, int>& crop)
+// With 'cfa' crop starts at even coordinates, so pattern of raw mosaic is preserved
+export cv::Mat cropImage(const cv::Mat& image, const std::tuple<int, int, int, int>& crop, bool cfa = false)
 {
-    const std::vector<std::filesystem::path> croppedImages = Utils::processImages(images, wd, [&crop](const cv::Mat& image)
-    {
-        const int height = image.rows;
-        const int width = image.cols;
+    const int height = image.rows;
+    const int width = image.cols;
+
+    const int cropWidth = std::min(std::get<0>(crop), width);
+    const int cropHeight = std::min(std::get<1>(crop), height);
+    const int cropDX = std::get<2>(crop);
+    const int cropDY = std::get<3>(crop);
 
-        const int cropWidth = std::min(std::get<0>(crop), width);
-        const int cropHeight = std::min(std::get<1>(crop), height);
-        const int cropDX = std::get<2>(crop);
-        const int cropDY = std::get<3>(crop);
+    const int centerX = width / 2;
+    const int centerY = height / 2;
 
-        const int centerX = width / 2;
-        const int centerY = height / 2;
+    const int startX = centerX + cropDX - cropWidth / 2;
+    const int startY = centerY + cropDY - cropHeight / 2;
 
-        const int startX = centerX + cropDX - cropWidth / 2;
-        const int startY = centerY + cropDY - cropHeight / 2;
+    const cv::Rect rect(startX, startY, cropWidth, cropHeight);
+    const cv::Rect roi = cfa? alignToCfa(rect): rect;
+    const cv::Mat croppedImage = image(roi);
+
+    return croppedImage;
+}
 
-        const cv::Rect roi(startX, startY, cropWidth, cropHeight);
-        const cv::Mat croppedImage = image(roi);
 
-        return croppedImage;
+export std::vector<std::filesystem::path> cropImages(const std::filesystem::path& wd, std::span<const std::filesystem::path> images, const std::tuple<int, int, int, int>& crop)
+{
+    const bool cfa = images.empty() == false && bayerPattern(images.front()).has_value();
+
+    const std::vector<std::filesystem::path> croppedImages = Utils::processImages(images, wd, [&crop, cfa](const cv::Mat& image)
+    {
+        return cropImage(image, crop, cfa);
     });
 
     return croppedImages;
@@ -5,7 +5,6 @@ module;
 #include <vector>
 #include <opencv2/opencv.hpp>
 #include <opencv2/imgproc.hpp>
-#include <opencv2/photo.hpp>
 
 export module images_enhancer;
 import utils;
@@ -13,49 +12,59 @@ import utils;
 
 namespace
 {
-    cv::Mat richardsonLucyDeconvolution(const cv::Mat& image, const cv::Mat& psf, int iterations) {
-        cv::Mat estimate = image.clone();
-        cv::Mat estimatePrevious;
-        cv::Mat psfFlipped;
-        cv::flip(psf, psfFlipped, -1);
+    cv::Mat enhanceContrast(const cv::Mat& img)
+    {
+        cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE();
+        clahe->setClipLimit(4.0);
 
-        for (int i = 0; i < iterations; i++)
+        // mono image is its own lightness channel
+        if (img.channels() == 1)
         {
-            cv::filter2D(estimate, estimatePrevious, -1, psfFlipped, cv::Point(-1, -1), 0, cv::BORDER_REPLICATE);
-            cv::divide(image, estimatePrevious, estimatePrevious);
-            cv::filter2D(estimatePrevious, estimatePrevious, -1, psf, cv::Point(-1, -1), 0, cv::BORDER_REPLICATE);
-            cv::multiply(estimate, estimatePrevious, estimate);
+            cv::Mat claheImage;
+            clahe->apply(img, claheImage);
+            return claheImage;
         }
 
-        return estimate;
-    }
+        // Lab conversion supports 8 bit and floating point images only, 16 bit ones are converted through floats
+        const bool is8Bit = img.depth() == CV_8U;
+        const double maxValue = Utils::maxValue(img);
 
-    cv::Mat enhanceContrast(const cv::Mat& img)
-    {
         cv::Mat labImage;
-        cv::cvtColor(img, labImage, cv::COLOR_BGR2Lab);
+        if (is8Bit)
+            cv::cvtColor(img, labImage, cv::COLOR_BGR2Lab);
+        else
+        {
+            img.convertTo(labImage, CV_32FC3, 1.0 / maxValue);
+            cv::cvtColor(labImage, labImage, cv::COLOR_BGR2Lab);
+        }
 
         std::vector<cv::Mat> labPlanes(3);
         cv::split(labImage, labPlanes);
 
-        cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE();
-        clahe->setClipLimit(4.0);
+        // CLAHE works on integer images, float lightness (0 - 100) is scaled to 16 bits
+        cv::Mat lightness;
+        if (is8Bit)
+            lightness = labPlanes[0];
+        else
+            labPlanes[0].convertTo(lightness, CV_16U, 65535.0 / 100.0);
+
         cv::Mat claheImage;
-        clahe->apply(labPlanes[0], claheImage);
+        clahe->apply(lightness, claheImage);
+
+        if (is8Bit)
+            claheImage.copyTo(labPlanes[0]);
+        else
+            claheImage.convertTo(labPlanes[0], CV_32F, 100.0 / 65535.0);
 
-        claheImage.copyTo(labPlanes[0]);
         cv::merge(labPlanes, labImage);
 
         cv::Mat result;
         cv::cvtColor(labImage, result, cv::COLOR_Lab2BGR);
-        return result;
-    }
 
-    cv::Mat reduceNoise(const cv::Mat& img)
-    {
-        cv::Mat denoised;
-        cv::fastNlMeansDenoisingColored(img, denoised, 10, 10, 7, 21);
-        return denoised;
+        if (is8Bit == false)
+            result.convertTo(result, img.type(), maxValue);
+
+        return result;
     }
 
     cv::Mat sharpenImage(const cv::Mat& img)
@@ -67,16 +76,34 @@ namespace
     }
 }
 
+
+export cv::Mat richardsonLucyDeconvolution(const cv::Mat& image, const cv::Mat& psf, int iterations) {
+    cv::Mat estimate = image.clone();
+    cv::Mat estimatePrevious;
+    cv::Mat psfFlipped;
+    cv::flip(psf, psfFlipped, -1);
+
+    for (int i = 0; i < iterations; i++)
+    {
+        cv::filter2D(estimate, estimatePrevious, -1, psfFlipped, cv::Point(-1, -1), 0, cv::BORDER_REPLICATE);
+        cv::divide(image, estimatePrevious, estimatePrevious);
+        cv::filter2D(estimatePrevious, estimatePrevious, -1, psf, cv::Point(-1, -1), 0, cv::BORDER_REPLICATE);
+        cv::multiply(estimate, estimatePrevious, estimate);
+    }
+
+    return estimate;
+}
+
+
 export std::vector<std::filesystem::path> enhanceImages(const std::filesystem::path& dir, std::span<const std::filesystem::path> images)
 {
-    const auto result = Utils::processImages(images, dir, [](const cv::Mat& image)
+    const auto result = Utils::processImages(images, dir, Utils::ImageRole::Output, [](const cv::Mat& image)
     {
         cv::Mat psf = cv::getGaussianKernel(21, 5, CV_32F);
         psf = psf * psf.t();
 
         const cv::Mat deconvolvedImage = richardsonLucyDeconvolution(image, psf, 10);
         const cv::Mat contrastEnhancedImage = enhanceContrast(deconvolvedImage);
-        const cv::Mat denoisedImage = reduceNoise(contrastEnhancedImage);
         const cv::Mat sharpenedImage = sharpenImage(contrastEnhancedImage);
 
         return sharpenedImage;
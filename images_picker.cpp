@@ -2,40 +2,28 @@
 module;
 
 #include <algorithm>
+#include <atomic>
 #include <filesystem>
 #include <numeric>
+#include <optional>
 #include <variant>
 #include <vector>
 #include <ranges>
+#include <span>
 #include <string>
 #include <opencv2/opencv.hpp>
+#include <spdlog/spdlog.h>
 
 export module images_picker;
 
+import bayer;
+import frame_metadata;
+import progress;
 import utils;
 
 
 namespace
 {
-    double computeSharpness(const cv::Mat& img)
-    {
-        cv::Mat gray, laplacian;
-        cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
-        cv::Laplacian(gray, laplacian, CV_64F);
-        cv::Scalar mu, sigma;
-        cv::meanStdDev(laplacian, mu, sigma);
-        return sigma.val[0] * sigma.val[0];
-    }
-
-    double computeContrast(const cv::Mat& img)
-    {
-        cv::Mat gray;
-        cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
-        cv::Scalar mu, sigma;
-        cv::meanStdDev(gray, mu, sigma);
-        return sigma.val[0];
-    }
-
     std::vector<size_t> selectTop(const std::vector<std::pair<double, size_t>>& images, int percent = 50) {
         std::vector<size_t> top;
         std::ranges::transform(images, std::back_inserter(top), [](const std::pair<double, size_t> score) {return score.second;});
@@ -46,25 +34,81 @@ namespace
     }
 }
 
+
+export double computeSharpness(const cv::Mat& gray)
+{
+    cv::Mat& laplacian = Utils::threadBuffer("laplacian", gray.size(), CV_64F);
+    cv::Laplacian(gray, laplacian, CV_64F);
+    cv::Scalar mu, sigma;
+    cv::meanStdDev(laplacian, mu, sigma);
+    return sigma.val[0] * sigma.val[0];
+}
+
+
+export double computeContrast(const cv::Mat& gray)
+{
+    cv::Scalar mu, sigma;
+    cv::meanStdDev(gray, mu, sigma);
+    return sigma.val[0];
+}
+
+
 export struct MedianPicker {};
 export using PickerMethod = std::variant<int, MedianPicker>;
 
-export std::vector<std::filesystem::path> pickImages(const std::filesystem::path& dir, std::span<const std::filesystem::path> images, const PickerMethod& method)
-{
-    std::vector<std::pair<double, size_t>> score;
 
-    const size_t count = images.size();
-    score.resize(count);
+// Quality of each image (higher is better). Scores known from frame metadata are reused.
+export std::vector<double> scoreImages(std::span<const std::filesystem::path> images, const Progress::Counter& progress = {})
+{
+    std::vector<double> scores(images.size());
+    const auto bayer = images.empty()? std::nullopt: bayerPattern(images.front());
+    const auto metadata = images.empty()? nullptr: frameMetadata(images.front());
+    std::atomic<size_t> reused = 0;
 
     Utils::forEach(images, [&](const size_t i)
     {
-        const cv::Mat image = cv::imread(images[i].string());
-        const double s = computeSharpness(image);
-        const double c = computeContrast(image);
+        if (const auto record = frameRecord(metadata, images[i]); record && record->score)
+        {
+            scores[i] = *record->score;
+            reused++;
+            progress.advance();
+            return;
+        }
+
+        const cv::Mat image = Utils::readImage(images[i]);
+
+        // raw mosaics are scored on green pixels: there are the most of them and they are not mixed with other colors
+        const cv::Mat& gray = bayer? cfaGreen(image, *bayer): Utils::toGray(image, Utils::threadBuffer("gray", image.size(), CV_MAKETYPE(image.depth(), 1)));
+
+        const double s = computeSharpness(gray);
+        const double c = computeContrast(gray);
+
+        scores[i] = s * c;
+
+        updateFrameMetadata(metadata, images[i], [&](FrameRecord& record)
+        {
+            record.score = scores[i];
+        });
 
-        score[i] = {s * c, i};
+        progress.advance();
     });
 
+    if (reused > 0)
+        spdlog::info("Scores of {} of {} images reused from frame metadata", reused.load(), images.size());
+
+    return scores;
+}
+
+
+// Indices of best images according to their scores, best first
+export std::vector<size_t> pickBest(std::span<const double> scores, const PickerMethod& method)
+{
+    std::vector<std::pair<double, size_t>> score;
+    score.reserve(scores.size());
+
+    for (size_t i = 0; i < scores.size(); i++)
+        score.emplace_back(scores[i], i);
+
     auto cmp = [](const auto& lhs, const auto& rhs)
     {
         return lhs.first > rhs.first;
@@ -72,24 +116,22 @@ export std::vector<std::filesystem::path> pickImages(const std::filesystem::path
 
     std::sort(score.begin(), score.end(), cmp);
 
-    auto processTop = [&](std::span<const size_t> top)
-    {
-        const auto topImages = top | std::ranges::views::transform([&](const auto& idx) { return images[idx]; });
-        const auto topPaths = Utils::copyFiles(std::vector<std::filesystem::path>(topImages.begin(), topImages.end()), dir);
-
-        return topPaths;
-    };
-
     if (const auto medianMethod = std::get_if<MedianPicker>(&method))
-    {
-        const auto top = selectTop(score);
-        return processTop(top);
-    }
+        return selectTop(score);
     else if (const auto topMethod = std::get_if<int>(&method))
-    {
-        const auto top = selectTop(score, *topMethod);
-        return processTop(top);
-    }
+        return selectTop(score, *topMethod);
     else
         return {};
 }
+
+
+export std::vector<std::filesystem::path> pickImages(const std::filesystem::path& dir, std::span<const std::filesystem::path> images, const PickerMethod& method)
+{
+    const auto scores = scoreImages(images, Progress::counter(dir));
+    const auto top = pickBest(scores, method);
+
+    const auto topImages = top | std::ranges::views::transform([&](const auto& idx) { return images[idx]; });
+    const auto topPaths = Utils::copyFiles(std::vector<std::filesystem::path>(topImages.begin(), topImages.end()), dir);
+
+    return topPaths;
+}
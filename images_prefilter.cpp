@@ -0,0 +1,180 @@
+
+module;
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <spdlog/spdlog.h>
+
+export module images_prefilter;
+import frame_metadata;
+import utils;
+
+
+namespace
+{
+    // brightness thresholds are given for 8 bit images and scaled for deeper ones
+    constexpr int thumbnailSize = 64;              // longer side of thumbnail
+    constexpr double minimalBrightness = 16;       // brightest pixel of frame with object
+    constexpr double saturation = 250;             // saturated pixel value
+    constexpr double maxSaturatedArea = 0.25;      // part of object which may be saturated
+    constexpr double minimalRelativeBrightness = 0.6;   // object's brightness relative to median of all frames
+
+    struct Thumbnail
+    {
+        double maxBrightness = 0;       // in 8 bit range
+        double objectBrightness = 0;    // mean brightness of object, in 8 bit range
+        double saturatedArea = 0;       // part of object's pixels which are saturated
+        std::uint64_t hash = 0;         // perceptual hash of thumbnail
+        std::uint64_t contentHash = 0;  // hash of all pixels of analyzed image
+    };
+
+    cv::Mat makeThumbnail(const cv::Mat& image)
+    {
+        const double scale = static_cast<double>(thumbnailSize) / std::max(image.cols, image.rows);
+
+        if (scale >= 1.0)
+            return image;
+
+        cv::Mat result;
+        cv::resize(image, result, cv::Size(), scale, scale, cv::INTER_AREA);
+
+        return result;
+    }
+
+    // Perceptual hashes of consecutive frames of a steady object are often equal, and so are their thumbnails after averaging
+    // out noise. So duplicate needs to have exactly the same pixels as previous frame at resolution it was analyzed in.
+    bool isDuplicate(const Thumbnail& thumbnail, const Thumbnail& previous)
+    {
+        return thumbnail.hash == previous.hash && thumbnail.contentHash == previous.contentHash;
+    }
+
+    // FNV-1a of image's size and pixels
+    std::uint64_t contentHash(const cv::Mat& image)
+    {
+        std::uint64_t hash = 14695981039346656037ull;
+
+        auto add = [&hash](const uchar* data, size_t size)
+        {
+            for (size_t i = 0; i < size; i++)
+                hash = (hash ^ data[i]) * 1099511628211ull;
+        };
+
+        const int size[] = {image.cols, image.rows, image.type()};
+        add(reinterpret_cast<const uchar *>(size), sizeof(size));
+
+        for (int y = 0; y < image.rows; y++)
+            add(image.ptr(y), image.cols * image.elemSize());
+
+        return hash;
+    }
+
+    // difference hash: each bit tells if pixel is brighter than its right neighbour on 9x8 image
+    std::uint64_t differenceHash(const cv::Mat& gray)
+    {
+        cv::Mat small;
+        cv::resize(gray, small, cv::Size(9, 8), 0, 0, cv::INTER_AREA);
+
+        std::uint64_t hash = 0;
+        for (int y = 0; y < 8; y++)
+            for (int x = 0; x < 8; x++)
+                hash = (hash << 1) | (small.at<uchar>(y, x) > small.at<uchar>(y, x + 1)? 1: 0);
+
+        return hash;
+    }
+
+    Thumbnail analyze(const cv::Mat& image)
+    {
+        const cv::Mat gray = makeThumbnail(image);
+        const double scale = Utils::maxValue(gray) / 255.0;
+
+        Thumbnail result;
+        double maxValue = 0;
+        cv::minMaxLoc(gray, nullptr, &maxValue);
+
+        // object region is found the same way as by object localizer
+        const cv::Mat object = gray > maxValue * 0.1;
+
+        const auto objectArea = cv::countNonZero(object);
+        if (objectArea > 0)
+        {
+            result.objectBrightness = cv::mean(gray, object)[0] / scale;
+
+            const cv::Mat saturated = gray > saturation * scale - 1;
+            result.saturatedArea = static_cast<double>(cv::countNonZero(saturated)) / objectArea;
+        }
+
+        result.maxBrightness = maxValue / scale;
+
+        cv::Mat buffer;
+        result.hash = differenceHash(Utils::to8Bit(gray, buffer));
+        result.contentHash = contentHash(image);
+
+        return result;
+    }
+}
+
+
+// Reject frames not worth processing: without object, saturated, clouded (much darker than others) and duplicated ones.
+// Frames are analyzed on small thumbnails, so rejection is cheap comparing to later steps.
+// Accepted frames are linked (see IFileManager::link: hard links when possible), so they survive removal of previous step with --cleanup.
+export std::vector<std::filesystem::path> prefilterImages(const std::filesystem::path& dir, std::span<const std::filesystem::path> images)
+{
+    std::vector<Thumbnail> thumbnails(images.size());
+
+    Utils::forEach(images, [&](const size_t i)
+    {
+        const cv::Mat image = Utils::readImage(images[i], cv::IMREAD_REDUCED_GRAYSCALE_4 | cv::IMREAD_ANYDEPTH);
+        thumbnails[i] = analyze(image);
+    });
+
+    std::vector<double> brightness;
+    for (const auto& thumbnail: thumbnails)
+        if (thumbnail.maxBrightness >= minimalBrightness)
+            brightness.push_back(thumbnail.objectBrightness);
+
+    std::optional<double> medianBrightness;
+    if (brightness.empty() == false)
+    {
+        std::ranges::nth_element(brightness, brightness.begin() + brightness.size() / 2);
+        medianBrightness = brightness[brightness.size() / 2];
+    }
+
+    std::vector<std::filesystem::path> accepted;
+    const auto metadata = frameMetadata(dir);
+
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        const auto& thumbnail = thumbnails[i];
+
+        std::optional<FrameRejection> rejection;
+        if (thumbnail.maxBrightness < minimalBrightness)
+            rejection = FrameRejection::Empty;
+        else if (thumbnail.saturatedArea > maxSaturatedArea)
+            rejection = FrameRejection::Clipped;
+        else if (thumbnail.objectBrightness < *medianBrightness * minimalRelativeBrightness)
+            rejection = FrameRejection::Clouded;
+        else if (i > 0 && isDuplicate(thumbnail, thumbnails[i - 1]))
+            rejection = FrameRejection::Duplicate;
+
+        if (rejection)
+            updateFrameMetadata(metadata, images[i], [&rejection](FrameRecord& record)
+            {
+                record.rejection = rejection;
+            });
+        else
+            accepted.push_back(images[i]);
+    }
+
+    spdlog::info("{} of {} frames rejected", images.size() - accepted.size(), images.size());
+
+    if (accepted.empty())
+        throw std::runtime_error("All frames were rejected by prefilter");
+
+    return Utils::linkFiles(accepted, dir);
+}
@@ -2,89 +2,168 @@
 module;
 
 #include <algorithm>
+#include <concepts>
 #include <filesystem>
+#include <ranges>
 #include <span>
+#include <stdexcept>
 #include <vector>
 #include <opencv2/opencv.hpp>
 
 export module images_stacker;
+import progress;
+import utils;
 
 
-namespace
+// Average of images. Images can be added and removed, so stack may follow a sliding window of frames.
+export class AverageStack
 {
-    cv::Mat averageStacking(const std::span<const std::filesystem::path> images)
+public:
+    void add(const cv::Mat& image)
     {
-        const cv::Mat firstImage = cv::imread(images.front().string());
-
-        cv::Mat cumulative = cv::Mat::zeros(firstImage.size(), CV_64FC3);
-
-        for (const auto& imagePath: images)
-        {
-            const cv::Mat image = cv::imread(imagePath.string());
+        accumulate(image, 1.0);
+        m_type = image.type();
+        m_count++;
+    }
 
-            cv::Mat imageFloat;
-            image.convertTo(imageFloat, CV_64FC3);
+    void remove(const cv::Mat& image)
+    {
+        accumulate(image, -1.0);
+        m_count--;
+    }
 
-            cumulative += imageFloat;
-        }
+    size_t count() const
+    {
+        return m_count;
+    }
 
-        cumulative /= static_cast<double>(images.size());
+    cv::Mat result() const
+    {
+        const cv::Mat average = m_sum / static_cast<double>(m_count);
 
         cv::Mat result;
-        cumulative.convertTo(result, firstImage.type());
+        average.convertTo(result, m_type);
 
         return result;
     }
 
+private:
+    cv::Mat m_sum;
+    size_t m_count = 0;
+    int m_type = -1;
+
+    void accumulate(const cv::Mat& image, double weight)
+    {
+        // sums of integer pixel values are exact in double, so removing an image restores previous state
+        if (m_sum.empty())
+            m_sum = cv::Mat::zeros(image.size(), CV_64FC(image.channels()));
+
+        cv::Mat& imageFloat = Utils::threadBuffer("imageFloat", image.size(), m_sum.type());
+        image.convertTo(imageFloat, m_sum.type());
+
+        cv::scaleAdd(imageFloat, weight, m_sum, m_sum);
+    }
+};
+
+
+export cv::Mat averageStacking(const std::span<const std::filesystem::path> images, const Progress::Counter& progress = {})
+{
+    AverageStack stack;
+
+    for (const auto& imagePath: images)
+    {
+        stack.add(Utils::readImage(imagePath));
+        progress.advance();
+    }
+
+    return stack.result();
+}
+
+
+namespace
+{
+    // order of color pixels is defined by their brightness
+    template<typename T>
+    double brightness(const cv::Vec<T, 3>& pixel)
+    {
+        return cv::norm(pixel);
+    }
+
+    template<std::integral T>
+    double brightness(T pixel)
+    {
+        return pixel;
+    }
 
-    cv::Mat medianStacking(const std::span<const std::filesystem::path> images)
+    template<typename Pixel>
+    cv::Mat medianStacking(const std::span<const std::filesystem::path> images, const cv::Mat& firstImage, const Progress::Counter& progress)
     {
         // TODO: rewrite with std::mdspan
-        const cv::Mat firstImage = cv::imread(images.front().string());
         const auto imagesCount = images.size();
-        std::vector<cv::Vec3b> pixels(imagesCount * firstImage.rows * firstImage.cols);
+        std::vector<Pixel> pixels(imagesCount * firstImage.rows * firstImage.cols);
 
         // Collect pixel values
-        #pragma omp parallel for
-        for (size_t i = 0; i < imagesCount; i++)
+        Utils::forEach(images, [&](const size_t i)
         {
-            const cv::Mat image = cv::imread(images[i].string());
+            const cv::Mat image = Utils::readImage(images[i]);
             for (int y = 0; y < image.rows; ++y)
                 for (int x = 0; x < image.cols; ++x)
-                    pixels[y * image.cols * imagesCount + x * imagesCount + i] = image.at<cv::Vec3b>(y, x);
-        }
+                    pixels[y * image.cols * imagesCount + x * imagesCount + i] = image.at<Pixel>(y, x);
+
+            progress.advance();
+        });
 
         cv::Mat result(firstImage.size(), firstImage.type());
 
         // Compute the median for each pixel
-        #pragma omp parallel for                                // TODO: restore collapse(2)
-        for (size_t y = 0; y < result.rows; y++)
+        Utils::forEach(std::views::iota(0, result.rows), [&](const size_t y)
+        {
             for (size_t x = 0; x < result.cols; x++)
             {
-                const std::span<cv::Vec3b> px(&pixels[y * result.cols * imagesCount + x * imagesCount], imagesCount);
-                std::sort(px.begin(), px.end(), [](const cv::Vec3b& a, const cv::Vec3b& b)
+                const std::span<Pixel> px(&pixels[y * result.cols * imagesCount + x * imagesCount], imagesCount);
+                std::sort(px.begin(), px.end(), [](const Pixel& a, const Pixel& b)
                 {
-                    return cv::norm(a) < cv::norm(b);
+                    return brightness(a) < brightness(b);
                 });
-                result.at<cv::Vec3b>(y, x) = px[px.size() / 2];
+                result.at<Pixel>(y, x) = px[px.size() / 2];
             }
+        });
 
         return result;
     }
 }
 
 
+export cv::Mat medianStacking(const std::span<const std::filesystem::path> images, const Progress::Counter& progress = {})
+{
+    const cv::Mat firstImage = Utils::readImage(images.front());
+
+    // kernel is chosen once per stack. Mono images take a third of memory and time of color ones
+    switch (firstImage.type())
+    {
+        case CV_8UC1:   return medianStacking<uchar>(images, firstImage, progress);
+        case CV_8UC3:   return medianStacking<cv::Vec3b>(images, firstImage, progress);
+        case CV_16UC1:  return medianStacking<ushort>(images, firstImage, progress);
+        case CV_16UC3:  return medianStacking<cv::Vec3w>(images, firstImage, progress);
+        default:
+            throw std::runtime_error("Unsupported type of images for median stacking: " + cv::typeToString(firstImage.type()));
+    }
+}
+
+
 export std::vector<std::filesystem::path> stackImages(const std::filesystem::path& dir, std::span<const std::filesystem::path> images)
 {
-    const auto averageImg = averageStacking(images);
+    // each image is read twice: for average and for median
+    const auto progress = Progress::counter(dir);
+    progress.setTotal(2 * images.size());
+
+    const auto averageImg = averageStacking(images, progress);
 
-    const auto pathAvg = dir / "average.png";
-    cv::imwrite(pathAvg.string(), averageImg);
+    const auto pathAvg = Utils::writeImage(dir / "average.png", averageImg, Utils::ImageRole::Output);
 
-    const auto medianImg = medianStacking(images);
+    const auto medianImg = medianStacking(images, progress);
 
-    const auto pathMdn = dir / "median.png";
-    cv::imwrite(pathMdn.string(), medianImg);
+    const auto pathMdn = Utils::writeImage(dir / "median.png", medianImg, Utils::ImageRole::Output);
 
     return {pathAvg, pathMdn};
 }
@@ -0,0 +1,149 @@
+module;
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options/parsers.hpp>
+
+export module job_spool;
+import json;
+
+
+// Spool directory layout:
+//  *.job       - jobs waiting for processing. Each contains command line arguments of astro-stacker (may span many lines, '#' starts a comment line)
+//                Job files are picked up as soon as they appear, so they need to be written under other name (like *.job.tmp) and renamed when complete
+//  running/    - jobs being processed
+//  done/       - finished jobs
+//  failed/     - jobs which could not be parsed or failed
+//  status/     - <job>.json with state and timings of each job, updated on every state change
+export struct Job
+{
+    std::string name;                       // job file's name without extension
+    std::filesystem::path file;             // current location of job file
+    std::vector<std::string> args;          // command line arguments
+};
+
+
+export enum class JobState
+{
+    Queued,
+    Running,
+    Done,
+    Failed,
+};
+
+
+export struct JobStatus
+{
+    JobState state;
+    int priority = 0;
+    std::vector<std::filesystem::path> inputs;
+    std::filesystem::path workingDir;
+    double waitTime = 0.0;                  // [s] from queueing to start
+    double runTime = 0.0;                   // [s] of processing
+    size_t failedInputs = 0;
+    std::string error;
+};
+
+
+export class JobSpool
+{
+public:
+    explicit JobSpool(std::filesystem::path dir)
+        : m_dir(std::move(dir))
+    {
+        for (const auto subdir: {"running", "done", "failed", "status"})
+            std::filesystem::create_directories(m_dir / subdir);
+    }
+
+    // Jobs waiting in spool, oldest first
+    std::vector<Job> pending() const
+    {
+        std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> files;
+
+        for (const auto& entry: std::filesystem::directory_iterator(m_dir))
+            if (entry.is_regular_file() && entry.path().extension() == ".job")
+                files.emplace_back(entry.last_write_time(), entry.path());
+
+        std::ranges::sort(files);
+
+        std::vector<Job> jobs;
+        for (const auto& [time, file]: files)
+            jobs.push_back(Job{
+                .name = file.stem().string(),
+                .file = file,
+                .args = readArgs(file),
+            });
+
+        return jobs;
+    }
+
+    Job start(const Job& job) const
+    {
+        return moveTo(job, "running");
+    }
+
+    Job finish(const Job& job, bool success) const
+    {
+        return moveTo(job, success? "done": "failed");
+    }
+
+    void writeStatus(const Job& job, const JobStatus& status) const
+    {
+        static constexpr const char* states[] = {"queued", "running", "done", "failed"};
+
+        std::string inputs;
+        for (const auto& input: status.inputs)
+            inputs += std::format("{}\"{}\"", inputs.empty()? "": ", ", escapeJson(input.string()));
+
+        const auto json = std::format(R"({{"job": "{}", "state": "{}", "priority": {}, "inputs": [{}], "working_dir": "{}", "wait_s": {:.3f}, "run_s": {:.3f}, "failed_inputs": {}, "error": "{}"}})",
+                                      escapeJson(job.name), states[static_cast<int>(status.state)], status.priority, inputs,
+                                      escapeJson(status.workingDir.string()), status.waitTime, status.runTime, status.failedInputs, escapeJson(status.error));
+
+        // written aside and renamed (which replaces previous status atomically), so readers never see partial file
+        const auto path = m_dir / "status" / (job.name + ".json");
+        const auto tmpPath = m_dir / "status" / (job.name + ".json.tmp");
+
+        {
+            std::ofstream file(tmpPath);
+            file << json << "\n";
+        }
+
+        std::filesystem::rename(tmpPath, path);
+    }
+
+private:
+    const std::filesystem::path m_dir;
+
+    static std::vector<std::string> readArgs(const std::filesystem::path& file)
+    {
+        std::ifstream stream(file);
+        std::string commandLine;
+
+        for (std::string line; std::getline(stream, line);)
+        {
+            boost::trim(line);
+
+            if (line.empty() == false && line.front() != '#')
+                commandLine += line + " ";
+        }
+
+        return boost::program_options::split_unix(commandLine);
+    }
+
+    Job moveTo(const Job& job, const std::string& subdir) const
+    {
+        Job moved = job;
+        moved.file = m_dir / subdir / job.file.filename();
+        std::filesystem::rename(job.file, moved.file);
+
+        return moved;
+    }
+};
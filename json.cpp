@@ -0,0 +1,40 @@
+module;
+
+#include <format>
+#include <string>
+#include <string_view>
+
+export module json;
+
+
+namespace Utils
+{
+    // Escape string to be put between quotes of JSON string. Control characters (like new lines in file names) are escaped too.
+    export std::string escapeJson(std::string_view str)
+    {
+        std::string result;
+        result.reserve(str.size());
+
+        for (const char c: str)
+        {
+            switch (c)
+            {
+                case '"':   result += "\\\""; break;
+                case '\\':  result += "\\\\"; break;
+                case '\b':  result += "\\b"; break;
+                case '\f':  result += "\\f"; break;
+                case '\n':  result += "\\n"; break;
+                case '\r':  result += "\\r"; break;
+                case '\t':  result += "\\t"; break;
+
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20)
+                        result += std::format("\\u{:04x}", static_cast<unsigned char>(c));
+                    else
+                        result.push_back(c);
+            }
+        }
+
+        return result;
+    }
+}
@@ -1,26 +1,45 @@
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
 #include <filesystem>
+#include <format>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <opencv2/opencv.hpp>
 #include <spdlog/spdlog.h>
 #include <spdlog/cfg/env.h>
-#include <omp.h>
 
 
-import aberration_fixer;
+import batch;
+import bayer;
 import config;
 import execution_plan_builder;
 import file_manager;
 import frame_extractor;
+import frame_metadata;
+import ifile_manager;
 import image_extractor;
-import images_aligner;
 import images_cropper;
-import images_enhancer;
-import images_picker;
 import images_splitter;
-import images_stacker;
+import job_spool;
+import memory_file_manager;
 import object_localizer;
-import transparency_applier;
+import progress;
+import ser_reader;
+import stacking_pipeline;
 import utils;
 
 
@@ -30,11 +49,23 @@ namespace
     {
         if (std::filesystem::is_directory(input))
             return countImages(input);
+        else if (isSerFile(input))
+            return serFrames(input);
         else
             return videoFrames(input);
     }
 
-    std::vector<std::filesystem::path> extractImages(const std::filesystem::path& dir, std::span<const std::filesystem::path> files, size_t firstFrame, size_t lastFrame)
+    cv::Mat readInputImage(const std::filesystem::path& input, size_t frame)
+    {
+        if (std::filesystem::is_directory(input))
+            return directoryImage(input, frame);
+        else if (isSerFile(input))
+            return serFrame(input, frame);
+        else
+            return videoFrame(input, frame);
+    }
+
+    std::vector<std::filesystem::path> extractImages(const std::filesystem::path& dir, std::span<const std::filesystem::path> files, size_t firstFrame, size_t lastFrame, const Utils::FrameTransformFactory& transform)
     {
         if (files.size() != 1)
             throw std::runtime_error("Unexpected number of input elements: " + std::to_string(files.size()));
@@ -42,42 +73,127 @@ namespace
         const auto& input = files.front();
 
         if (std::filesystem::is_directory(input))
-            return collectImages(dir, files, firstFrame, lastFrame);
+            return collectImages(dir, files, firstFrame, lastFrame, transform);
+        else if (isSerFile(input))
+            return extractSerFrames(dir, files, firstFrame, lastFrame, transform);
         else
-            return extractFrames(dir, files, firstFrame, lastFrame);
+            return extractFrames(dir, files, firstFrame, lastFrame, transform);
     }
-}
 
+    // Black and saturated frames (common at the beginning of capture) have identical channels in color captures too
+    bool hasContent(const cv::Mat& frame)
+    {
+        double minValue = 0, maxValue = 0;
+        cv::minMaxLoc(frame.reshape(1), &minValue, &maxValue);
 
-int main(int argc, char** argv)
-{
-    spdlog::cfg::load_env_levels();
+        const double range = Utils::maxValue(frame);
+        return maxValue > range * 0.05 && minValue < range * 0.95;
+    }
 
-    try
+    // Capture is mono when all frames with content, sampled over whole input, have identical channels
+    bool isMonoInput(const std::filesystem::path& input, size_t firstFrame, size_t lastFrame)
     {
-        const auto config = Config::readParams(argc, argv);
+        constexpr size_t samples = 5;
+        const size_t frames = lastFrame - firstFrame;
+        bool sampledContent = false;
 
-        Utils::WorkingDir wd(config.wd);
-        const auto& inputFiles = config.inputFiles;
+        for (size_t i = 0; i < std::min(samples, frames); i++)
+        {
+            const cv::Mat frame = readInputImage(input, firstFrame + i * frames / samples);
+
+            if (hasContent(frame) == false)
+                continue;
+
+            if (Utils::isMonochrome(frame) == false)
+                return false;
+
+            sampledContent = true;
+        }
+
+        return sampledContent;
+    }
+
+    using AcquisitionStep = std::function<std::vector<std::filesystem::path>(const std::filesystem::path &, std::span<const std::filesystem::path>)>;
+
+    // Object extraction or tracking, and crop can be done while frames are acquired,
+    // so only the region of interest is ever written to disk.
+    // Mono frames stored in three channels are reduced to one, so next steps process a third of data.
+    // Raw mosaics ('cfa') are cut along 2x2 cells of color filter array.
+    Utils::FrameTransformFactory acquisitionTransform(const std::optional<cv::Size>& objectSize, bool extract, const std::optional<std::tuple<int, int, int, int>>& crop, bool mono, bool cfa)
+    {
+        if (objectSize.has_value() == false && extract == false && crop.has_value() == false && mono == false)
+            return {};
+
+        return [objectSize, extract, crop, mono, cfa]() -> Utils::FrameTransform
+        {
+            const auto tracker = objectSize? std::make_shared<ObjectTracker>(*objectSize): nullptr;
+
+            return [tracker, extract, crop, mono, cfa](const cv::Mat& frame)
+            {
+                cv::Mat result = frame;
+
+                if (mono && result.channels() > 1)
+                    cv::cvtColor(frame, result, cv::COLOR_BGR2GRAY);
+
+                if (tracker)
+                    result = tracker->track(result);
+                else if (extract)
+                {
+                    // frames without object are kept whole, so prefilter can reject them
+                    const cv::Mat object = extractBrightestObject(result, cfa);
+
+                    if (object.empty() == false)
+                        result = object;
+                }
+
+                if (crop)
+                    result = cropImage(result, *crop, cfa);
+
+                return result;
+            };
+        };
+    }
+
+    // Process single capture (video file or directory with images)
+    void processInput(const Config::Config& config, const std::filesystem::path& inputFile, Utils::WorkingDir wd, IFileManager& fm)
+    {
         const auto& skip = config.skip;
         const auto& split = config.split;
+        const auto& slidingWindow = config.slidingWindow;
         const auto& doObjectDetection = config.doObjectDetection;
+        const auto& objectTracking = config.objectTracking;
         const auto& crop = config.crop;
-        const auto& pickerMethod = config.pickerMethod;
         const auto& stopAfter = config.stopAfter;
-        const auto& backgroundThreshold = config.backgroundThreshold;
-        const auto& threads = config.threads;
         const auto& debugSteps = config.debugSteps;
-        const auto& cleanup = config.cleanup;
+        const std::vector<std::filesystem::path> inputFiles = {inputFile};
 
-        const auto maxThreads = omp_get_max_threads();
-        auto useThreads = threads > 0? threads: maxThreads + threads;
-        useThreads = std::clamp(useThreads, 1, maxThreads);
+        const auto metadata = std::make_shared<FrameMetadata>();
+        const FrameMetadataRegistration metadataRegistration(wd.path(), metadata);
 
-        spdlog::info("Using {} threads", useThreads);
-        omp_set_num_threads(useThreads);
+        // rerun reuses what previous run computed (currently scores of frames).
+        // Inputs of batch have their metadata in subdirectories of previous run's working directory, like in the current one.
+        if (config.loadMetadata)
+        {
+            const auto previousMetadataPath = *config.loadMetadata / std::filesystem::relative(wd.path(), config.wd) / "metadata.bin";
+
+            try
+            {
+                metadata->load(previousMetadataPath);
+                spdlog::info("Loaded frame metadata of previous run from {}", previousMetadataPath.string());
+            }
+            catch (const std::runtime_error& error)
+            {
+                spdlog::warn("Frame metadata of previous run not used: {}", error.what());
+            }
+        }
 
-        const auto& inputFile = config.inputFiles.front();
+        // raw frames are processed as mosaics until they are stacked
+        const auto bayer = config.bayer? config.bayer: isSerFile(inputFile)? serBayerPattern(inputFile): std::nullopt;
+        if (bayer)
+            metadata->setBayerPattern(*bayer);
+
+        // directory is listed once for this run
+        const auto listing = std::filesystem::is_directory(inputFile)? std::make_optional<DirectoryListing>(inputFile): std::nullopt;
 
         const size_t firstFrame = skip;
         const size_t lastFrame = countInputImages(inputFile);
@@ -91,39 +207,116 @@ int main(int argc, char** argv)
         const size_t segmentSize = framesInSegmentToBeTaken + framesInSegmentToBeIgnored;
         const size_t segments = Utils::divideWithRoundUp(frames, segmentSize);
 
-        const FileManager fm(cleanup);
+        // tracker moves its window by any number of pixels, which would break color filter array pattern
+        const bool useTracking = objectTracking && bayer.has_value() == false;
+        if (objectTracking && useTracking == false)
+            spdlog::warn("Object tracking is not supported for raw input, main object will be extracted from each frame");
 
-        std::vector<std::pair<int, std::filesystem::path>> allImages;
-        for(int i = 0; i < segments; i++)
+        // with --debug-steps tracking or extraction runs as a separate step, so its debug output can be stored
+        const bool trackOnAcquisition = doObjectDetection && useTracking && debugSteps == false;
+        const bool extractOnAcquisition = doObjectDetection && useTracking == false && debugSteps == false;
+        const bool cropOnAcquisition = crop.has_value() && (doObjectDetection == false || trackOnAcquisition || extractOnAcquisition);
+
+        const cv::Mat firstImage = readInputImage(inputFile, firstFrame);
+
+        // mosaic saved as color image (like a video of raw frames) is reduced to one channel
+        const bool toMono = firstImage.channels() > 1 && (bayer || config.colorMode == Config::ColorMode::Mono ||
+                                                          (config.colorMode == Config::ColorMode::Auto && isMonoInput(inputFile, firstFrame, lastFrame)));
+
+        if (toMono && bayer.has_value() == false)
+            spdlog::info("Mono input, frames will be processed as single channel images");
+
+        std::optional<cv::Size> objectSize;
+        if (trackOnAcquisition)
+        {
+            objectSize = ObjectTracker::objectSize(firstImage);
+
+            if (objectSize.has_value() == false)
+                throw std::runtime_error("No object found on the first frame.");
+        }
+
+        const PipelineOptions pipelineOptions {
+            .prefilter = config.prefilter,
+            .objectDetection = doObjectDetection == false || trackOnAcquisition || extractOnAcquisition? ObjectDetection::None: useTracking? ObjectDetection::Track: ObjectDetection::Extract,
+            .crop = cropOnAcquisition? std::nullopt: crop,
+            .chromaMethod = config.chromaMethod,
+            .slidingWindow = slidingWindow? std::optional(std::pair<size_t, size_t>(slidingWindow->first, slidingWindow->second)): std::nullopt,
+            .pickerMethod = config.pickerMethod,
+            .alignment = {
+                .method = config.alignmentMethod,
+                .ecc = {
+                    .maxIterations = config.alignMaxIterations,
+                    .timeBudget = config.alignTimeBudget,
+                },
+            },
+            .bayer = bayer,
+            .backgroundThreshold = config.backgroundThreshold,
+            .debugSteps = debugSteps,
+        };
+
+        const auto transform = acquisitionTransform(objectSize, extractOnAcquisition, cropOnAcquisition? crop: std::nullopt, toMono, bayer.has_value());
+
+        std::vector<std::pair<size_t, size_t>> segmentFrames;
+        std::vector<Utils::WorkingDir> segmentWorkingDirs;
+        for(size_t i = 0; i < segments; i++)
         {
-            spdlog::info("Processing segment {} of {}", i + 1, segments);
             const auto segmentBegin = i * segmentSize;
             const auto segmentEnd = std::min(segmentBegin + segmentSize - framesInSegmentToBeIgnored, lastFrame);
 
-            Utils::WorkingDir segmentWorkingDir = segments == 1? wd : wd.getExactSubDir(std::to_string(i + 1));
-
-            ExecutionPlanBuilder epb(segmentWorkingDir, fm, stopAfter);
-            epb.addStep("Acquiring input images.", "images", extractImages, segmentBegin, segmentEnd);
+            segmentFrames.emplace_back(segmentBegin, segmentEnd);
+            segmentWorkingDirs.push_back(segments == 1? wd : wd.getExactSubDir(std::to_string(i + 1)));
+        }
 
-            if (doObjectDetection)
-                epb.addStep("Extracting main object.", "object", extractObject, debugSteps);
+        std::mutex allImagesMutex;
+        std::vector<std::pair<int, std::filesystem::path>> allImages;
 
-            if (crop.has_value())
-                epb.addStep("Cropping.", "crop", cropImages, *crop);
+        auto processSegment = [&](size_t i, const AcquisitionStep& acquire)
+        {
+            spdlog::info("Processing segment {} of {}", i + 1, segments);
 
-            epb.addStep("Fixing chromatic abberation", "chroma", fixChromaticAberration, debugSteps);
-            epb.addStep("Choosing best images.", "best", pickImages, pickerMethod);
-            epb.addStep("Aligning images.", "aligned", alignImages);
-            epb.addStep("Stacking images.", "stacked", stackImages);
-            epb.addStep("Enhancing images.", "enhanced", enhanceImages);
+            ExecutionPlanBuilder epb(segmentWorkingDirs[i], fm, stopAfter);
+            epb.addStep("Acquiring input images.", "images", acquire);
+            addProcessingSteps(epb, pipelineOptions);
 
-            if (backgroundThreshold >= 0)
-                epb.addPostStep("Applying transparency.", "transparent", applyTransparency, backgroundThreshold);
+            const auto results = epb.execute(inputFiles);
+            const auto segmentFiles = fm.persist(results);
 
-            const auto segmentFiles = epb.execute(inputFiles);
+            std::lock_guard lock(allImagesMutex);
             for (const auto& path: segmentFiles)
                 allImages.emplace_back(i, path);
+        };
+
+        if (segments > 1 && std::filesystem::is_directory(inputFile) == false && isSerFile(inputFile) == false)
+        {
+            // decode video once for all segments. Each segment is processed as soon as its frames are ready
+            std::vector<std::filesystem::path> imagesDirs;
+            for (auto segmentWorkingDir: segmentWorkingDirs)           // copy, as plan of segment will create the same subdir for input images
+                imagesDirs.push_back(segmentWorkingDir.getSubDir("images").path());
+
+            Utils::TaskGroup segmentJobs;
+            extractSegments(inputFile, segmentFrames, imagesDirs, transform, [&](size_t i, std::vector<std::filesystem::path> frames)
+            {
+                segmentJobs.run([&processSegment, i, frames]
+                {
+                    processSegment(i, [frames](const std::filesystem::path &, std::span<const std::filesystem::path>)
+                    {
+                        return frames;
+                    });
+                });
+            });
+
+            segmentJobs.wait();
         }
+        else
+            for(size_t i = 0; i < segments; i++)
+            {
+                const auto [segmentBegin, segmentEnd] = segmentFrames[i];
+
+                processSegment(i, [segmentBegin, segmentEnd, &transform](const std::filesystem::path& dir, std::span<const std::filesystem::path> files)
+                {
+                    return extractImages(dir, files, segmentBegin, segmentEnd, transform);
+                });
+            }
 
         if (config.collect && segments > 1)
         {
@@ -138,6 +331,282 @@ int main(int argc, char** argv)
                 Utils::copyFile(srcPath, outputPath);
             }
         }
+
+        if (config.saveMetadata)
+        {
+            std::filesystem::create_directories(wd.path());
+            metadata->save(wd.path() / "metadata.bin");
+        }
+    }
+
+    // Process all inputs of config. Returns number of failed inputs, throws when single input fails.
+    size_t processJob(const Config::Config& config, const Utils::WorkingDir& wd, IFileManager& fm)
+    {
+        if (config.inputFiles.size() == 1)
+        {
+            processInput(config, config.inputFiles.front(), wd, fm);
+            return 0;
+        }
+        else
+            return processBatch(config.inputFiles, config.parallelJobs, [&](const std::filesystem::path& input, const std::string& name)
+            {
+                processInput(config, input, wd.getExactSubDir(name), fm);
+            });
+    }
+
+    using Clock = std::chrono::steady_clock;
+    constexpr auto spoolPollInterval = std::chrono::seconds(1);
+
+    std::atomic<bool> stopRequested = false;
+
+    void requestStop(int)
+    {
+        stopRequested = true;
+    }
+
+    double secondsSince(Clock::time_point time)
+    {
+        return std::chrono::duration<double>(Clock::now() - time).count();
+    }
+
+    struct QueuedJob
+    {
+        Job job;
+        Config::Config config;
+        Utils::WorkingDir wd;
+        Clock::time_point queued;
+
+        JobStatus status(JobState state) const
+        {
+            return JobStatus {
+                .state = state,
+                .priority = config.priority,
+                .inputs = config.inputFiles,
+                .workingDir = wd.path(),
+            };
+        }
+    };
+
+    // Options set up once for whole daemon process
+    constexpr std::array daemonOptions = {
+        "threads", "decode-threads", "encode-threads", "queue-depth", "intermediate-codec", "output-codec",
+        "in-memory", "cleanup", "progress-interval", "progress-format", "daemon",
+    };
+
+    // Job's own options, with daemon's working directory when job does not set one
+    Config::Config readJobConfig(const Job& job, const Config::Config& daemonConfig)
+    {
+        auto args = job.args;
+
+        for (const auto& arg: args)
+        {
+            if (arg.starts_with("--") == false)
+                continue;
+
+            // options may be given by unambiguous prefix
+            const auto name = std::string_view(arg).substr(2, arg.find('=') - 2);
+            const auto option = std::ranges::find_if(daemonOptions, [name](std::string_view option) { return option.starts_with(name); });
+
+            if (name.empty() == false && option != daemonOptions.end())
+                throw std::invalid_argument(std::format("--{} applies to whole daemon and cannot be set by job", *option));
+        }
+
+        const bool hasWorkingDir = std::ranges::any_of(args, [](const std::string& arg)
+        {
+            return arg.starts_with("--working-dir");
+        });
+
+        if (hasWorkingDir == false)
+            args.insert(args.begin(), {"--working-dir", daemonConfig.wdRoot.string()});
+
+        return Config::readParams(args);
+    }
+
+    void runJob(const JobSpool& spool, const QueuedJob& queued, IFileManager& fm)
+    {
+        const auto& job = queued.job;
+
+        auto status = queued.status(JobState::Running);
+        status.waitTime = secondsSince(queued.queued);
+        spool.writeStatus(job, status);
+
+        spdlog::info("Starting job {} (waited {:.1f}s)", job.name, status.waitTime);
+        const auto start = Clock::now();
+
+        try
+        {
+            status.failedInputs = processJob(queued.config, queued.wd, fm);
+            status.state = status.failedInputs == 0? JobState::Done: JobState::Failed;
+        }
+        catch (const std::exception& error)
+        {
+            status.state = JobState::Failed;
+            status.error = error.what();
+        }
+
+        status.runTime = secondsSince(start);
+        spool.writeStatus(spool.finish(job, status.state == JobState::Done), status);
+
+        if (status.state == JobState::Done)
+            spdlog::info("Job {} finished in {:.1f}s", job.name, status.runTime);
+        else
+            spdlog::error("Job {} failed after {:.1f}s: {}", job.name, status.runTime, status.error.empty()? std::format("{} inputs failed", status.failedInputs): status.error);
+    }
+
+    // Keep process (thread pools, codecs, file manager) warm and run jobs dropped into spool directory,
+    // so each capture pays only for its own processing. Stops on SIGINT or SIGTERM, after running jobs are finished.
+    void runDaemon(const Config::Config& config, IFileManager& fm)
+    {
+        const JobSpool spool(*config.daemonSpool);
+
+        std::signal(SIGINT, requestStop);
+        std::signal(SIGTERM, requestStop);
+
+        // higher priority first, jobs of equal priority in order of arrival
+        std::multimap<int, QueuedJob, std::greater<>> queue;
+        std::set<std::string> queuedNames;
+
+        std::mutex runningMutex;
+        std::condition_variable jobFinished;
+        size_t runningJobs = 0;
+
+        // Jobs get their own threads. Running them as tasks of the global pool could leave no thread for tasks
+        // they wait for (like encoding of decoded frames), as main thread does not help the pool.
+        Utils::TaskPool jobsPool(config.parallelJobs + 1);
+        Utils::TaskGroup jobs(jobsPool);
+
+        // job's slot is released even when its results could not be stored in spool
+        struct JobSlot
+        {
+            std::mutex& mutex;
+            std::condition_variable& finished;
+            size_t& running;
+
+            ~JobSlot()
+            {
+                std::lock_guard lock(mutex);
+                running--;
+                finished.notify_one();
+            }
+        };
+
+        spdlog::info("Waiting for jobs in {}", config.daemonSpool->string());
+
+        while (stopRequested == false)
+        {
+            for (const auto& job: spool.pending())
+            {
+                if (queuedNames.contains(job.name))
+                    continue;
+
+                try
+                {
+                    auto jobConfig = readJobConfig(job, config);
+                    const auto wd = Utils::WorkingDir(jobConfig.wd).getExactSubDir(job.name);
+                    const auto priority = jobConfig.priority;
+
+                    QueuedJob queued {
+                        .job = job,
+                        .config = std::move(jobConfig),
+                        .wd = wd,
+                        .queued = Clock::now(),
+                    };
+
+                    spool.writeStatus(job, queued.status(JobState::Queued));
+                    queue.emplace(priority, std::move(queued));
+                    queuedNames.insert(job.name);
+
+                    spdlog::info("Job {} queued with priority {}", job.name, priority);
+                }
+                catch (const std::exception& error)
+                {
+                    spdlog::error("Invalid job {}: {}", job.name, error.what());
+                    spool.writeStatus(spool.finish(job, false), JobStatus{.state = JobState::Failed, .error = error.what()});
+                }
+            }
+
+            std::unique_lock lock(runningMutex);
+
+            while (runningJobs < config.parallelJobs && queue.empty() == false)
+            {
+                auto queued = std::move(queue.extract(queue.begin()).mapped());
+                queuedNames.erase(queued.job.name);
+                queued.job = spool.start(queued.job);
+                runningJobs++;
+
+                jobs.run([&spool, &fm, &runningMutex, &jobFinished, &runningJobs, queued = std::move(queued)]
+                {
+                    const JobSlot slot{runningMutex, jobFinished, runningJobs};
+
+                    try
+                    {
+                        runJob(spool, queued, fm);
+                    }
+                    catch (const std::exception& error)
+                    {
+                        spdlog::error("Could not store results of job {}: {}", queued.job.name, error.what());
+                    }
+                });
+            }
+
+            jobFinished.wait_for(lock, spoolPollInterval);
+        }
+
+        spdlog::info("Stopping daemon, waiting for running jobs to finish");
+        jobs.wait();
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    spdlog::cfg::load_env_levels();
+
+    try
+    {
+        const auto config = Config::readParams(argc, argv);
+
+        Utils::WorkingDir wd(config.wd);
+        const auto& threads = config.threads;
+        const auto& cleanup = config.cleanup;
+
+        const auto maxThreads = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+        auto useThreads = threads > 0? threads: maxThreads + threads;
+        useThreads = std::clamp(useThreads, 1, maxThreads);
+
+        spdlog::info("Using {} threads", useThreads);
+        Utils::TaskPool::setGlobalThreads(static_cast<size_t>(useThreads));
+        if (config.intermediateCodec)
+            Utils::setCodecPolicy(Utils::ImageRole::Intermediate, *config.intermediateCodec);
+
+        if (config.outputCodec)
+            Utils::setCodecPolicy(Utils::ImageRole::Output, *config.outputCodec);
+
+        Utils::setPipelineOptions({
+            .decodeThreads = config.decodeThreads,
+            .encodeThreads = config.encodeThreads,
+            .queueDepth = config.queueDepth,
+        });
+
+        std::unique_ptr<IFileManager> fm;
+        if (config.inMemory)
+            fm = std::make_unique<MemoryFileManager>();
+        else
+            fm = std::make_unique<FileManager>(cleanup);
+
+        Utils::setFileManager(*fm);
+
+        std::optional<Progress::Reporter> progressReporter;
+        if (config.progressInterval.count() > 0)
+            progressReporter.emplace(config.progressInterval, config.progressFormat);
+
+        if (config.daemonSpool)
+            runDaemon(config, *fm);
+        else if (const auto failedJobs = processJob(config, wd, *fm); failedJobs > 0)
+        {
+            spdlog::error("{} of {} jobs failed", failedJobs, config.inputFiles.size());
+            return 1;
+        }
     }
     catch (const std::runtime_error& error)
     {
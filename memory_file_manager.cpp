@@ -0,0 +1,178 @@
+module;
+
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+export module memory_file_manager;
+import ifile_manager;
+import utils;
+
+
+// Keeps working directories in memory, so intermediate images are neither encoded nor written to disk.
+// Only persisted files are stored on disk. Files not known to manager (like input images) are read from disk.
+// Images are shared between readers and must not be modified in place.
+export class MemoryFileManager: public IFileManager
+{
+public:
+    MemoryFileManager() = default;
+
+    MemoryFileManager(const MemoryFileManager &) = delete;
+    MemoryFileManager& operator=(const MemoryFileManager &) = delete;
+
+    void remove(const std::filesystem::path& dir) override
+    {
+        Utils::forgetConsumableFiles(dir);
+
+        auto isInDir = [&dir](const std::filesystem::path& file)
+        {
+            return std::mismatch(dir.begin(), dir.end(), file.begin(), file.end()).first == dir.end();
+        };
+
+        std::lock_guard lock(m_mutex);
+
+        // entries from one directory are next to each other
+        auto it = m_files.lower_bound(dir);
+        while (it != m_files.end() && isInDir(it->first))
+            it = m_files.erase(it);
+    }
+
+    void consumable(std::span<const std::filesystem::path> files) override
+    {
+        // memory is always released, there is nothing to be inspected after run
+        Utils::addConsumableFiles(files, [this](const std::filesystem::path& file)
+        {
+            std::lock_guard lock(m_mutex);
+            m_files.erase(file);
+        });
+    }
+
+    void create(const std::filesystem::path &) override
+    {
+        // directories exist implicitly
+    }
+
+    cv::Mat read(const std::filesystem::path& path, int flags) override
+    {
+        const auto file = find(path);
+
+        if (file.has_value() == false)
+            return IFileManager::read(path, flags);
+        else if (file->source)
+            return IFileManager::read(*file->source, flags);
+        else
+            return decode(file->image, flags);
+    }
+
+    void write(const std::filesystem::path& path, const cv::Mat& image, const std::vector<int>& parameters) override
+    {
+        // written images may be views of reusable buffers, keep own copy
+        store(path, File{.image = image.clone(), .parameters = parameters});
+    }
+
+    // Store image without copying it, so frames owned by caller can be processed without any I/O. Image must not be modified while stored.
+    void add(const std::filesystem::path& path, const cv::Mat& image)
+    {
+        store(path, File{.image = image});
+    }
+
+    void copy(const std::filesystem::path& from, const std::filesystem::path& to) override
+    {
+        // stored images are never modified, so copy can share them
+        if (auto file = find(from))
+            store(to, *file);
+        else
+            IFileManager::copy(from, to);
+    }
+
+    void link(const std::filesystem::path& from, const std::filesystem::path& to) override
+    {
+        if (auto file = find(from))
+            store(to, *file);
+        else
+            store(to, File{.source = std::filesystem::absolute(from)});
+    }
+
+    std::vector<std::filesystem::path> persist(std::span<const std::filesystem::path> files) override
+    {
+        for (const auto& path: files)
+        {
+            const auto file = find(path);
+            if (file.has_value() == false)
+                continue;                       // already on disk
+
+            std::filesystem::create_directories(path.parent_path());
+
+            if (file->source)
+                std::filesystem::copy_file(*file->source, path, std::filesystem::copy_options::overwrite_existing);
+            else if (cv::imwrite(path.string(), file->image, file->parameters) == false)
+                throw std::runtime_error("Could not write " + path.string());
+
+            std::lock_guard lock(m_mutex);
+            m_files.erase(path);
+        }
+
+        return {files.begin(), files.end()};
+    }
+
+private:
+    struct File
+    {
+        cv::Mat image;
+        std::vector<int> parameters;                        // codec parameters used when file is persisted
+        std::optional<std::filesystem::path> source;        // file on disk (for linked files)
+    };
+
+    std::mutex m_mutex;
+    std::map<std::filesystem::path, File> m_files;
+
+    std::optional<File> find(const std::filesystem::path& path)
+    {
+        std::lock_guard lock(m_mutex);
+
+        const auto it = m_files.find(path);
+        if (it == m_files.end())
+            return {};
+        else
+            return it->second;
+    }
+
+    void store(const std::filesystem::path& path, File file)
+    {
+        std::lock_guard lock(m_mutex);
+        m_files.insert_or_assign(path, std::move(file));
+    }
+
+    // convert stored image the same way cv::imread would for given flags
+    static cv::Mat decode(const cv::Mat& image, int flags)
+    {
+        if (flags == cv::IMREAD_UNCHANGED)
+            return image;
+
+        cv::Mat result = image;
+
+        if ((flags & cv::IMREAD_ANYDEPTH) == 0 && result.depth() != CV_8U)
+        {
+            const double scale = result.depth() == CV_16U? 1.0 / 256: 1.0;
+            result.convertTo(result, CV_8U, scale);
+        }
+
+        const bool gray = (flags & cv::IMREAD_COLOR) == 0 && (flags & cv::IMREAD_ANYCOLOR) == 0;
+        const bool anyColor = (flags & cv::IMREAD_ANYCOLOR) != 0;
+
+        if (result.channels() == 4)
+            cv::cvtColor(result, result, gray? cv::COLOR_BGRA2GRAY: cv::COLOR_BGRA2BGR);
+        else if (result.channels() == 3 && gray)
+            cv::cvtColor(result, result, cv::COLOR_BGR2GRAY);
+        else if (result.channels() == 1 && gray == false && anyColor == false)
+            cv::cvtColor(result, result, cv::COLOR_GRAY2BGR);
+
+        return result;
+    }
+};
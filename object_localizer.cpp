@@ -1,22 +1,24 @@
-
 module;
 
 #include <filesystem>
 #include <optional>
 #include <vector>
 #include <opencv2/opencv.hpp>
+#include <spdlog/spdlog.h>
 
 export module object_localizer;
 
+import bayer;
+import frame_metadata;
 import utils;
 
 
 namespace
 {
-    std::pair<cv::Mat, cv::Mat> findBrightestObject(const cv::Mat& img)
+    std::optional<std::vector<cv::Point>> findLargestContour(const cv::Mat& img, std::vector<std::vector<cv::Point>>& contours)
     {
-        cv::Mat gray;
-        cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+        cv::Mat grayBuffer;
+        const cv::Mat& gray = Utils::toGray(img, grayBuffer);
 
         // Apply a threshold to find bright regions
         cv::Mat binary;
@@ -24,10 +26,11 @@ namespace
         cv::minMaxLoc(gray, nullptr, &maxVal);
         cv::threshold(gray, binary, maxVal * 0.1, 255, cv::THRESH_BINARY);
 
-        cv::Mat contoursImg = img.clone();
+        // contours are found on 8 bit images only
+        if (binary.depth() != CV_8U)
+            binary.convertTo(binary, CV_8U);
 
         // Find contours
-        std::vector<std::vector<cv::Point>> contours;
         cv::findContours(binary, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
 
         // Find the largest contour
@@ -35,8 +38,6 @@ namespace
         std::optional<std::size_t> maxAreaIdx;
         for (size_t i = 0; i < contours.size(); i++)
         {
-            cv::rectangle(contoursImg, cv::boundingRect(contours[i]), {0, 255, 0}, 1);
-
             const double area = cv::contourArea(contours[i]);
             if (area > maxArea)
             {
@@ -46,37 +47,280 @@ namespace
         }
 
         if (maxAreaIdx.has_value() == false)
-        {
-            std::cerr << "Error: No contours found." << std::endl;
             return {};
-        }
 
-        // Compute bounding box with margin
-        cv::Rect bbox = cv::boundingRect(contours[*maxAreaIdx]);
+        return contours[*maxAreaIdx];
+    }
+
+    cv::Rect addMargin(cv::Rect bbox, const cv::Size& imageSize)
+    {
         const int hmargin = static_cast<int>(bbox.width * 0.05);
         const int vmargin = static_cast<int>(bbox.width * 0.05);
         bbox.x = std::max(bbox.x - hmargin, 0);
         bbox.y = std::max(bbox.y - vmargin, 0);
-        bbox.width = std::min(bbox.width + 2 * hmargin, img.cols - bbox.x);
-        bbox.height = std::min(bbox.height + 2 * vmargin, img.rows - bbox.y);
+        bbox.width = std::min(bbox.width + 2 * hmargin, imageSize.width - bbox.x);
+        bbox.height = std::min(bbox.height + 2 * vmargin, imageSize.height - bbox.y);
+
+        return bbox;
+    }
+
+    std::optional<cv::Point2f> findBrightestObjectCenter(const cv::Mat& img)
+    {
+        std::vector<std::vector<cv::Point>> contours;
+        const auto largestContour = findLargestContour(img, contours);
+
+        if (largestContour.has_value() == false)
+            return {};
+
+        const cv::Moments moments = cv::moments(*largestContour);
+        if (moments.m00 > 0)
+            return cv::Point2f(static_cast<float>(moments.m10 / moments.m00), static_cast<float>(moments.m01 / moments.m00));
+
+        const cv::Rect bbox = cv::boundingRect(*largestContour);
+        return cv::Point2f(bbox.x + bbox.width / 2.f, bbox.y + bbox.height / 2.f);
+    }
+}
+
+
+export std::pair<cv::Mat, cv::Mat> findBrightestObject(const cv::Mat& img, bool debug)
+{
+    std::vector<std::vector<cv::Point>> contours;
+    const auto largestContour = findLargestContour(img, contours);
+
+    cv::Mat contoursImg;
+    if (debug)
+    {
+        // contours are drawn in color
+        if (img.channels() == 1)
+            cv::cvtColor(img, contoursImg, cv::COLOR_GRAY2BGR);
+        else
+            contoursImg = img.clone();
 
-        const cv::Mat object = img(bbox);
-        return {object, contoursImg};
+        for (const auto& contour: contours)
+            cv::rectangle(contoursImg, cv::boundingRect(contour), {0, 255, 0}, 1);
     }
+
+    if (largestContour.has_value() == false)
+    {
+        spdlog::warn("No object found on frame");
+        return {};
+    }
+
+    // Compute bounding box with margin
+    const cv::Rect bbox = addMargin(cv::boundingRect(*largestContour), img.size());
+
+    const cv::Mat object = img(bbox);
+    return {object, contoursImg};
+}
+
+
+// Brightest object cut from image (shares its pixels), or empty image when there is no object.
+// Raw mosaic ('cfa') can be cut only between 2x2 cells, otherwise its pattern would change.
+export cv::Mat extractBrightestObject(const cv::Mat& image, bool cfa)
+{
+    const cv::Mat object = findBrightestObject(image, false).first;
+
+    if (object.empty() || cfa == false)
+        return object;
+
+    // object is a region of image
+    cv::Size size;
+    cv::Point objectOffset, imageOffset;
+    object.locateROI(size, objectOffset);
+    image.locateROI(size, imageOffset);
+
+    return image(alignToCfa(cv::Rect(objectOffset - imageOffset, object.size())));
 }
 
 
+// Follows object over consecutive frames. Object is looked for in a small window around its last
+// known position, full frame is scanned only for the first frame or when object gets lost.
+export class ObjectTracker
+{
+public:
+    explicit ObjectTracker(const cv::Size& objectSize)
+        : m_objectSize(objectSize)
+    {
+
+    }
+
+    cv::Mat track(const cv::Mat& image)
+    {
+        if (const auto center = locate(image))
+            m_center = *center;
+        else if (m_center.has_value() == false)
+        {
+            spdlog::warn("No object found on frame, tracking starts from its center");
+            m_center = cv::Point2f(image.cols / 2.f, image.rows / 2.f);
+        }
+
+        cv::Mat object;
+
+        // sub pixel extraction supports 8 bit and floating point images only
+        if (image.depth() == CV_16U)
+        {
+            cv::Mat& imageFloat = Utils::threadBuffer("trackedFloat", image.size(), CV_MAKETYPE(CV_32F, image.channels()));
+            image.convertTo(imageFloat, CV_32F);
+
+            cv::Mat objectFloat;
+            cv::getRectSubPix(imageFloat, m_objectSize, *m_center, objectFloat);
+            objectFloat.convertTo(object, image.depth());
+        }
+        else
+            cv::getRectSubPix(image, m_objectSize, *m_center, object);
+
+        return object;
+    }
+
+    // region of last tracked object
+    cv::Rect objectRect() const
+    {
+        if (m_center.has_value() == false)
+            return {};
+
+        const cv::Point2f tl = *m_center - cv::Point2f(m_objectSize.width / 2.f, m_objectSize.height / 2.f);
+        return cv::Rect(cv::Point(cvRound(tl.x), cvRound(tl.y)), m_objectSize);
+    }
+
+    cv::Rect searchWindow(const cv::Size& imageSize) const
+    {
+        if (m_center.has_value() == false)
+            return cv::Rect(cv::Point(0, 0), imageSize);
+
+        // object may move by half of its size between frames
+        const cv::Size windowSize(m_objectSize.width * 2, m_objectSize.height * 2);
+        const cv::Rect window(cv::Point(*m_center) - cv::Point(windowSize.width / 2, windowSize.height / 2), windowSize);
+
+        return window & cv::Rect(cv::Point(0, 0), imageSize);
+    }
+
+    static std::optional<cv::Size> objectSize(const cv::Mat& image)
+    {
+        std::vector<std::vector<cv::Point>> contours;
+        const auto largestContour = findLargestContour(image, contours);
+
+        if (largestContour.has_value() == false)
+            return {};
+
+        return addMargin(cv::boundingRect(*largestContour), image.size()).size();
+    }
+
+private:
+    std::optional<cv::Point2f> m_center;
+    const cv::Size m_objectSize;
+
+    std::optional<cv::Point2f> locate(const cv::Mat& image) const
+    {
+        if (m_center.has_value())
+        {
+            const cv::Rect window = searchWindow(image.size());
+
+            if (window.empty() == false)
+                if (const auto center = findBrightestObjectCenter(image(window)))
+                    return *center + cv::Point2f(window.tl());
+        }
+
+        // no previous position or object lost - look for it in the whole frame
+        return findBrightestObjectCenter(image);
+    }
+};
+
+
 export std::vector<std::filesystem::path> extractObject(const std::filesystem::path& dir, std::span<const std::filesystem::path> images, bool debug)
 {
     const auto contoursDir = dir / "contours";
     const auto objectsDir = dir / "objects";
 
-    const auto extractedObjects = Utils::processImages(images, std::array{objectsDir, contoursDir}, debug, [](const cv::Mat& image)
+    const bool cfa = images.empty() == false && bayerPattern(images.front()).has_value();
+    const auto metadata = frameMetadata(dir);
+
+    const auto extractedObjects = Utils::processImages(images, std::array{objectsDir, contoursDir}, debug, [debug, cfa, &metadata](const cv::Mat& image, const std::filesystem::path& path)
     {
-        const auto [object, contours] = findBrightestObject(image);
+        auto [object, contours] = findBrightestObject(image, debug);
+
+        if (object.empty() == false)
+        {
+            // object is a region of image
+            cv::Size imageSize;
+            cv::Point offset;
+            object.locateROI(imageSize, offset);
+
+            cv::Rect objectRect(offset, object.size());
+
+            // raw mosaic can be cut only between 2x2 cells, otherwise its pattern would change
+            if (cfa)
+            {
+                objectRect = alignToCfa(objectRect);
+                object = image(objectRect);
+            }
+
+            updateFrameMetadata(metadata, path, [&objectRect](FrameRecord& record)
+            {
+                record.object = objectRect;
+            });
+        }
 
         return std::array{object, contours};
     });
 
     return extractedObjects;
 }
+
+
+export std::vector<std::filesystem::path> trackObject(const std::filesystem::path& dir, std::span<const std::filesystem::path> images, bool debug)
+{
+    if (images.empty())
+        return {};
+
+    // the same layout as of extractObject
+    const auto windowsDir = dir / "windows";
+    const auto objectsDir = Utils::prepareOutputDirs(std::array{dir / "objects", windowsDir}, debug);
+
+    const cv::Mat firstImage = Utils::readImage(images.front());
+    const auto objectSize = ObjectTracker::objectSize(firstImage);
+
+    if (objectSize.has_value() == false)
+        throw std::runtime_error("No object found on the first frame: " + images.front().string());
+
+    // Tracking is sequential by nature. Split frames into continous regions, one tracker per region.
+    const auto segments = Utils::split({0, images.size()}, Utils::threads());
+
+    std::vector<std::filesystem::path> trackedObjects(images.size());
+    const auto metadata = frameMetadata(dir);
+
+    Utils::forEach(segments, [&](const size_t s)
+    {
+        const auto& [segmentFirst, segmentLast] = segments[s];
+        ObjectTracker tracker(*objectSize);
+
+        for (size_t i = segmentFirst; i < segmentLast; i++)
+        {
+            const auto& imagePath = images[i];
+            const auto imageFilename = imagePath.filename();
+            const cv::Mat image = Utils::readImage(imagePath);
+            Utils::fileConsumed(imagePath);
+
+            if (debug)
+            {
+                cv::Mat windowImg;
+                if (image.channels() == 1)
+                    cv::cvtColor(image, windowImg, cv::COLOR_GRAY2BGR);
+                else
+                    windowImg = image.clone();
+
+                cv::rectangle(windowImg, tracker.searchWindow(image.size()), {0, 255, 0}, 1);
+                Utils::writeImage(windowsDir / imageFilename, windowImg);
+            }
+
+            const cv::Mat object = tracker.track(image);
+            updateFrameMetadata(metadata, imagePath, [&tracker](FrameRecord& record)
+            {
+                record.object = tracker.objectRect();
+            });
+
+            trackedObjects[i] = Utils::writeImage(objectsDir / imageFilename, object);
+        }
+    });
+
+    return trackedObjects;
+}
@@ -0,0 +1,273 @@
+
+module;
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <format>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_sinks.h>
+
+export module progress;
+import json;
+
+
+namespace Progress
+{
+    // Counters of a running step. Updated from hot loops, so only relaxed atomic operations are used.
+    export class Step
+    {
+    public:
+        Step(std::string name, size_t total)
+            : m_name(std::move(name))
+            , m_started(std::chrono::steady_clock::now())
+            , m_total(total)
+        {
+
+        }
+
+        void advance(size_t frames = 1) noexcept
+        {
+            m_done.fetch_add(frames, std::memory_order_relaxed);
+        }
+
+        // Steps may know their real amount of work after they started (like frames in video)
+        void setTotal(size_t total) noexcept
+        {
+            m_total.store(total, std::memory_order_relaxed);
+        }
+
+        size_t done() const noexcept
+        {
+            return m_done.load(std::memory_order_relaxed);
+        }
+
+        size_t total() const noexcept
+        {
+            return m_total.load(std::memory_order_relaxed);
+        }
+
+        const std::string& name() const
+        {
+            return m_name;
+        }
+
+        std::chrono::steady_clock::time_point started() const
+        {
+            return m_started;
+        }
+
+    private:
+        const std::string m_name;
+        const std::chrono::steady_clock::time_point m_started;
+        std::atomic<size_t> m_done = 0;
+        std::atomic<size_t> m_total;
+    };
+
+
+    // Handle to counters of a step. Does nothing when step is not tracked, so it can be used unconditionally.
+    export class Counter
+    {
+    public:
+        Counter() = default;
+
+        explicit Counter(std::shared_ptr<Step> step)
+            : m_step(std::move(step))
+        {
+
+        }
+
+        void advance(size_t frames = 1) const noexcept
+        {
+            if (m_step)
+                m_step->advance(frames);
+        }
+
+        void setTotal(size_t total) const noexcept
+        {
+            if (m_step)
+                m_step->setTotal(total);
+        }
+
+    private:
+        std::shared_ptr<Step> m_step;
+    };
+}
+
+
+namespace
+{
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Progress::Step>> steps;                         // in order of start
+        std::map<std::filesystem::path, std::shared_ptr<Progress::Step>> dirs;      // steps writing to directories
+    };
+
+    Registry& registry()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    std::string formatDuration(double seconds)
+    {
+        const auto total = static_cast<long long>(seconds + 0.5);
+        return std::format("{}:{:02}:{:02}", total / 3600, total / 60 % 60, total % 60);
+    }
+
+}
+
+
+namespace Progress
+{
+    // Registers step for its lifetime. Step with directory can be found by code working in it (see counter())
+    export class StepScope
+    {
+    public:
+        StepScope(std::string name, size_t total, const std::filesystem::path& dir = {})
+            : m_step(std::make_shared<Step>(std::move(name), total))
+            , m_dir(dir)
+        {
+            auto& r = registry();
+            std::lock_guard lock(r.mutex);
+
+            r.steps.push_back(m_step);
+
+            if (m_dir.empty() == false)
+                r.dirs[m_dir] = m_step;
+        }
+
+        StepScope(const StepScope &) = delete;
+        StepScope& operator=(const StepScope &) = delete;
+
+        ~StepScope()
+        {
+            auto& r = registry();
+            std::lock_guard lock(r.mutex);
+
+            std::erase(r.steps, m_step);
+
+            if (const auto it = r.dirs.find(m_dir); it != r.dirs.end() && it->second == m_step)
+                r.dirs.erase(it);
+        }
+
+        Counter counter() const
+        {
+            return Counter(m_step);
+        }
+
+    private:
+        const std::shared_ptr<Step> m_step;
+        const std::filesystem::path m_dir;
+    };
+
+
+    // Counter of step working in directory containing 'path'. Involves lookup, so should be called before loops, not in them.
+    export Counter counter(const std::filesystem::path& path)
+    {
+        auto& r = registry();
+        std::lock_guard lock(r.mutex);
+
+        std::shared_ptr<Step> result;
+        size_t depth = 0;
+
+        for (const auto& [dir, step]: r.dirs)
+        {
+            const auto dirDepth = static_cast<size_t>(std::distance(dir.begin(), dir.end()));
+            const bool contains = std::mismatch(dir.begin(), dir.end(), path.begin(), path.end()).first == dir.end();
+
+            // most nested directory wins
+            if (contains && dirDepth >= depth)
+            {
+                result = step;
+                depth = dirDepth;
+            }
+        }
+
+        return Counter(result);
+    }
+
+
+    export std::vector<std::shared_ptr<const Step>> activeSteps()
+    {
+        auto& r = registry();
+        std::lock_guard lock(r.mutex);
+
+        return {r.steps.begin(), r.steps.end()};
+    }
+
+
+    export enum class ReportFormat
+    {
+        Human,
+        Json,       // one JSON object per line
+    };
+
+
+    // Periodically reports progress, speed and ETA of active steps
+    export class Reporter
+    {
+    public:
+        Reporter(std::chrono::milliseconds interval, ReportFormat format)
+            : m_interval(interval)
+            , m_format(format)
+            , m_jsonLogger(std::make_shared<spdlog::logger>("progress", std::make_shared<spdlog::sinks::stdout_sink_mt>()))
+        {
+            m_jsonLogger->set_pattern("%v");
+
+            m_thread = std::jthread([this](std::stop_token stopToken)
+            {
+                std::mutex mutex;
+                std::unique_lock lock(mutex);
+
+                // nobody notifies, wait ends after interval or when reporter is destroyed
+                while (stopToken.stop_requested() == false)
+                {
+                    m_wakeUp.wait_for(lock, stopToken, m_interval, [] { return false; });
+
+                    if (stopToken.stop_requested() == false)
+                        report();
+                }
+            });
+        }
+
+        Reporter(const Reporter &) = delete;
+        Reporter& operator=(const Reporter &) = delete;
+
+    private:
+        const std::chrono::milliseconds m_interval;
+        const ReportFormat m_format;
+        const std::shared_ptr<spdlog::logger> m_jsonLogger;
+        std::condition_variable_any m_wakeUp;
+        std::jthread m_thread;
+
+        void report() const
+        {
+            const auto now = std::chrono::steady_clock::now();
+
+            for (const auto& step: activeSteps())
+            {
+                const auto done = step->done();
+                const auto total = std::max(step->total(), done);
+                const auto elapsed = std::chrono::duration<double>(now - step->started()).count();
+                const double fps = elapsed > 0? static_cast<double>(done) / elapsed: 0.0;
+                const double eta = fps > 0? static_cast<double>(total - done) / fps: -1.0;      // negative when unknown
+
+                if (m_format == ReportFormat::Json)
+                    m_jsonLogger->info(R"({{"step": "{}", "done": {}, "total": {}, "fps": {:.2f}, "elapsed_s": {:.1f}, "eta_s": {:.1f}}})",
+                                       Utils::escapeJson(step->name()), done, total, fps, elapsed, eta);
+                else
+                    spdlog::info("{}: {}/{} frames, {:.1f} frames/s, ETA {}", step->name(), done, total, fps, eta < 0? "unknown": formatDuration(eta));
+            }
+        }
+    };
+}
@@ -0,0 +1,235 @@
+module;
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <spdlog/spdlog.h>
+
+export module ser_reader;
+import bayer;
+import frame_metadata;
+import progress;
+import utils;
+
+
+// Reader of SER files (raw captures written by planetary cameras' capture software)
+namespace
+{
+    constexpr size_t HeaderSize = 178;
+
+    struct SerHeader
+    {
+        std::int32_t colorId;
+        std::int32_t width;
+        std::int32_t height;
+        std::int32_t depth;             // bits per pixel of each plane
+        size_t frames;
+
+        int planes() const
+        {
+            return colorId >= 100? 3: 1;
+        }
+
+        size_t bytesPerPixel() const
+        {
+            return static_cast<size_t>(planes() * (depth > 8? 2: 1));
+        }
+
+        size_t frameBytes() const
+        {
+            return static_cast<size_t>(width) * static_cast<size_t>(height) * bytesPerPixel();
+        }
+    };
+
+    std::int32_t readInt32(const char* data)
+    {
+        std::int32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    SerHeader readHeader(std::ifstream& file, const std::filesystem::path& path)
+    {
+        char header[HeaderSize];
+        if (file.read(header, HeaderSize).gcount() != static_cast<std::streamsize>(HeaderSize) || std::memcmp(header, "LUCAM-RECORDER", 14) != 0)
+            throw std::runtime_error("Not a SER file: " + path.string());
+
+        // Little endian flag is not used: capture programs disagree on its meaning, and all of them write little endian data
+        const SerHeader result {
+            .colorId = readInt32(header + 18),
+            .width = readInt32(header + 26),
+            .height = readInt32(header + 30),
+            .depth = readInt32(header + 34),
+            .frames = static_cast<size_t>(std::max(readInt32(header + 38), 0)),
+        };
+
+        if (result.width <= 0 || result.height <= 0 || result.depth <= 0 || result.depth > 16)
+            throw std::runtime_error("Unsupported SER file: " + path.string());
+
+        return result;
+    }
+
+    SerHeader openSer(const std::filesystem::path& path, std::ifstream& file)
+    {
+        file.open(path, std::ios::binary);
+        if (file.is_open() == false)
+            throw std::runtime_error("Could not open " + path.string());
+
+        return readHeader(file, path);
+    }
+
+    cv::Mat readFrame(std::ifstream& file, const SerHeader& header, size_t frame)
+    {
+        const auto bytes = header.frameBytes();
+        const int type = CV_MAKETYPE(header.depth > 8? CV_16U: CV_8U, header.planes());
+
+        cv::Mat raw(header.height, header.width, type);
+        file.seekg(static_cast<std::streamoff>(HeaderSize + frame * bytes));
+
+        if (file.read(reinterpret_cast<char *>(raw.data), static_cast<std::streamsize>(bytes)).gcount() != static_cast<std::streamsize>(bytes))
+            throw std::runtime_error(std::format("Could not read frame {} of SER file", frame));
+
+        // samples of 9 - 15 bit cameras are scaled to full 16 bit range, so they are stored like any other 16 bit image
+        cv::Mat frameMat;
+        if (header.depth > 8 && header.depth < 16)
+            raw.convertTo(frameMat, raw.type(), 1 << (16 - header.depth));
+        else
+            frameMat = raw;
+
+        if (header.colorId == 100)          // RGB
+            cv::cvtColor(frameMat, frameMat, cv::COLOR_RGB2BGR);
+
+        return frameMat;
+    }
+
+    // Optional trailer holds capture time of each frame (in 100 ns units). Returns times in ms relative to the first frame.
+    std::vector<double> readTimestamps(std::ifstream& file, const SerHeader& header)
+    {
+        const auto trailer = HeaderSize + header.frames * header.frameBytes();
+        std::vector<std::int64_t> ticks(header.frames);
+
+        file.seekg(static_cast<std::streamoff>(trailer));
+        const auto bytes = static_cast<std::streamsize>(ticks.size() * sizeof(std::int64_t));
+        if (header.frames == 0 || file.read(reinterpret_cast<char *>(ticks.data()), bytes).gcount() != bytes)
+        {
+            file.clear();
+            return {};
+        }
+
+        std::vector<double> timestamps(ticks.size());
+        for (size_t i = 0; i < ticks.size(); i++)
+            timestamps[i] = static_cast<double>(ticks[i] - ticks.front()) / 10000.0;
+
+        return timestamps;
+    }
+
+    std::vector<std::filesystem::path> extractSerFrames(const std::filesystem::path& file, const std::filesystem::path& dir, size_t firstFrame, size_t lastFrame, const Utils::FrameTransformFactory& transformFactory, const Progress::Counter& progress)
+    {
+        std::ifstream input;
+        const auto header = openSer(file, input);
+        const auto timestamps = readTimestamps(input, header);
+        const auto fileName = file.filename().string();
+        const auto transform = transformFactory? transformFactory(): Utils::FrameTransform{};
+        const auto metadata = frameMetadata(dir);
+
+        std::vector<std::filesystem::path> paths;
+        paths.reserve(lastFrame - firstFrame);
+
+        for(size_t frame = firstFrame; frame < lastFrame; frame++)
+        {
+            const cv::Mat frameMat = readFrame(input, header, frame);
+
+            const std::filesystem::path path = dir / std::format("{}-{}.png", fileName, frame);
+            paths.push_back(Utils::writeImage(path, transform? transform(frameMat): frameMat));
+            progress.advance();
+
+            updateFrameMetadata(metadata, paths.back(), [&](FrameRecord& record)
+            {
+                record.size = frameMat.size();
+
+                if (frame < timestamps.size())
+                    record.timestamp = timestamps[frame];
+            });
+        }
+
+        return paths;
+    }
+}
+
+
+export bool isSerFile(const std::filesystem::path& file)
+{
+    const auto extension = file.extension();
+    return extension == ".ser" || extension == ".SER";
+}
+
+
+export size_t serFrames(const std::filesystem::path& file)
+{
+    std::ifstream input;
+    return openSer(file, input).frames;
+}
+
+
+export cv::Mat serFrame(const std::filesystem::path& file, size_t frame)
+{
+    std::ifstream input;
+    const auto header = openSer(file, input);
+
+    if (frame >= header.frames)
+        throw std::out_of_range("frame index > number of frames");
+
+    return readFrame(input, header, frame);
+}
+
+
+// Pattern of color filter array when file contains raw frames of color camera
+export std::optional<BayerPattern> serBayerPattern(const std::filesystem::path& file)
+{
+    std::ifstream input;
+
+    switch (openSer(file, input).colorId)
+    {
+        case 8:  return BayerPattern::RGGB;
+        case 9:  return BayerPattern::GRBG;
+        case 10: return BayerPattern::GBRG;
+        case 11: return BayerPattern::BGGR;
+        default: return {};
+    }
+}
+
+
+export std::vector<std::filesystem::path> extractSerFrames(const std::filesystem::path& dir, std::span<const std::filesystem::path> files, size_t firstFrame, size_t lastFrame, const Utils::FrameTransformFactory& transform = {})
+{
+    const auto file = files.front();
+    const auto frames = lastFrame - firstFrame;
+
+    // frames have constant size, so each thread can read its continous region directly
+    const auto segments = Utils::split({firstFrame, lastFrame}, Utils::threads());
+    std::vector<std::filesystem::path> paths(frames);
+
+    const auto progress = Progress::counter(dir);
+    progress.setTotal(frames);
+
+    Utils::forEach(segments, [&](const size_t segment)
+    {
+        const auto& [segmentFirstFrame, segmentLastFrame] = segments[segment];
+
+        spdlog::debug("Segment #{} got frames {} - {} ({} frames)", segment, segmentFirstFrame, segmentLastFrame - 1, segmentLastFrame - segmentFirstFrame);
+
+        const auto segmentPaths = extractSerFrames(file, dir, segmentFirstFrame, segmentLastFrame, transform, progress);
+
+        for(size_t out_f = segmentFirstFrame, in_f = 0; out_f < segmentLastFrame; out_f++, in_f++)
+            paths[out_f - firstFrame] = segmentPaths[in_f];
+    });
+
+    return paths;
+}
@@ -0,0 +1,82 @@
+module;
+
+#include <optional>
+#include <tuple>
+#include <utility>
+
+export module stacking_pipeline;
+import aberration_fixer;
+import bayer;
+import execution_plan_builder;
+import images_aligner;
+import images_cropper;
+import images_enhancer;
+import images_picker;
+import images_prefilter;
+import images_stacker;
+import object_localizer;
+import transparency_applier;
+import window_stacker;
+
+
+export enum class ObjectDetection
+{
+    None,
+    Extract,                // find object on each frame separately
+    Track,                  // find object once and track it over next frames
+};
+
+
+export struct PipelineOptions
+{
+    bool prefilter = false;
+    ObjectDetection objectDetection = ObjectDetection::Extract;
+    std::optional<std::tuple<int, int, int, int>> crop;
+    ChromaticAberrationMethod chromaMethod = ChromaticAberrationMethod::Homography;
+    std::optional<std::pair<size_t, size_t>> slidingWindow;        // length and step
+    PickerMethod pickerMethod = MedianPicker{};
+    AlignmentOptions alignment;
+    std::optional<BayerPattern> bayer;                              // frames are raw mosaics
+    int backgroundThreshold = -1;                                   // negative for no transparency
+    bool debugSteps = false;
+};
+
+
+// Steps turning acquired frames into enhanced stacks
+export void addProcessingSteps(ExecutionPlanBuilder& epb, const PipelineOptions& options)
+{
+    if (options.prefilter)
+        epb.addStep("Rejecting unusable images.", "prefiltered", prefilterImages);
+
+    if (options.objectDetection == ObjectDetection::Track)
+        epb.addStep("Tracking main object.", "object", trackObject, options.debugSteps);
+    else if (options.objectDetection == ObjectDetection::Extract)
+        epb.addStep("Extracting main object.", "object", extractObject, options.debugSteps);
+
+    if (options.crop)
+        epb.addStep("Cropping.", "crop", cropImages, *options.crop);
+
+    // raw mosaics have no color channels to register until they are debayered
+    if (options.bayer.has_value() == false)
+        epb.addStep("Fixing chromatic abberation", "chroma", fixChromaticAberration, options.chromaMethod, options.debugSteps);
+
+    if (options.slidingWindow)
+        epb.addStep("Stacking sliding windows.", "windows", stackWindows, options.slidingWindow->first, options.slidingWindow->second, options.pickerMethod, options.alignment);
+    else
+    {
+        epb.addStep("Choosing best images.", "best", pickImages, options.pickerMethod);
+        epb.addStep("Aligning images.", "aligned", alignImages, options.alignment);
+        epb.addStep("Stacking images.", "stacked", stackImages);
+    }
+
+    if (options.bayer)
+    {
+        epb.addStep("Debayering.", "debayered", debayerImages, *options.bayer);
+        epb.addStep("Fixing chromatic abberation", "chroma", fixChromaticAberration, options.chromaMethod, options.debugSteps);
+    }
+
+    epb.addStep("Enhancing images.", "enhanced", enhanceImages);
+
+    if (options.backgroundThreshold >= 0)
+        epb.addPostStep("Applying transparency.", "transparent", applyTransparency, options.backgroundThreshold);
+}
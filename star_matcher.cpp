@@ -0,0 +1,214 @@
+module;
+
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+export module star_matcher;
+
+
+// Registration of sparse fields (deep sky, wide field) by their stars. Stars are matched with triangles:
+// ratios of sides of a triangle do not depend on shift, rotation and scale of the field.
+namespace
+{
+    constexpr double detectionSigma = 5.0;          // star is brighter than background by this many standard deviations
+    constexpr int maxStarArea = 400;                // larger blobs are not stars (planets, nebulae, hot columns)
+    constexpr size_t maxStars = 50;                 // brightest stars kept for matching
+    constexpr size_t triangleStars = 15;            // brightest stars forming triangles
+    constexpr float minTriangleSide = 5.0f;         // smaller triangles have unstable side ratios
+    constexpr float maxDescriptorDistance = 0.01f;
+    constexpr double ransacThreshold = 2.0;         // maximal reprojection error of inlier [px]
+    constexpr size_t minMatches = 4;
+
+    // Intensity weighted centroid of connected component
+    std::pair<cv::Point2f, double> centroid(const cv::Mat& gray, const cv::Mat& labels, int label, const cv::Rect& rect)
+    {
+        cv::Mat patch;
+        gray(rect).convertTo(patch, CV_32F);
+        patch.setTo(0, labels(rect) != label);
+
+        const cv::Moments moments = cv::moments(patch);
+        if (moments.m00 <= 0)
+            return {cv::Point2f(rect.x + rect.width / 2.f, rect.y + rect.height / 2.f), 0.0};
+
+        const cv::Point2f center(static_cast<float>(rect.x + moments.m10 / moments.m00), static_cast<float>(rect.y + moments.m01 / moments.m00));
+        return {center, moments.m00};
+    }
+
+    float distance(const cv::Point2f& a, const cv::Point2f& b)
+    {
+        return static_cast<float>(cv::norm(a - b));
+    }
+}
+
+
+export struct Triangle
+{
+    std::array<size_t, 3> stars;        // ordered by length of opposite side, from the longest
+    cv::Vec2f descriptor;               // middle and shortest side relative to the longest one
+};
+
+
+export struct StarField
+{
+    std::vector<cv::Point2f> stars;     // from the brightest
+    std::vector<Triangle> triangles;
+};
+
+
+// Stars found with threshold over background, positioned with sub-pixel accuracy
+export std::vector<cv::Point2f> detectStars(const cv::Mat& gray)
+{
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(gray, mean, stddev);
+
+    cv::Mat binary;
+    cv::threshold(gray, binary, mean[0] + detectionSigma * stddev[0], 255, cv::THRESH_BINARY);
+
+    // components are found on 8 bit images only
+    if (binary.depth() != CV_8U)
+        binary.convertTo(binary, CV_8U);
+
+    cv::Mat labels, stats, centroids;
+    const int components = cv::connectedComponentsWithStats(binary, labels, stats, centroids, 8, CV_32S);
+
+    std::vector<std::pair<cv::Point2f, double>> stars;
+    for (int label = 1; label < components; label++)
+    {
+        // single pixels are noise or hot pixels
+        const int area = stats.at<int>(label, cv::CC_STAT_AREA);
+        if (area < 2 || area > maxStarArea)
+            continue;
+
+        const cv::Rect rect(stats.at<int>(label, cv::CC_STAT_LEFT), stats.at<int>(label, cv::CC_STAT_TOP),
+                            stats.at<int>(label, cv::CC_STAT_WIDTH), stats.at<int>(label, cv::CC_STAT_HEIGHT));
+
+        stars.push_back(centroid(gray, labels, label, rect));
+    }
+
+    std::ranges::sort(stars, std::greater{}, &std::pair<cv::Point2f, double>::second);
+
+    std::vector<cv::Point2f> result;
+    for (size_t i = 0; i < std::min(stars.size(), maxStars); i++)
+        result.push_back(stars[i].first);
+
+    return result;
+}
+
+
+export std::vector<Triangle> makeTriangles(const std::vector<cv::Point2f>& stars)
+{
+    const auto n = std::min(stars.size(), triangleStars);
+    std::vector<Triangle> triangles;
+
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = i + 1; j < n; j++)
+            for (size_t k = j + 1; k < n; k++)
+            {
+                // each vertex with length of opposite side
+                std::array<std::pair<float, size_t>, 3> vertices = {{
+                    {distance(stars[j], stars[k]), i},
+                    {distance(stars[i], stars[k]), j},
+                    {distance(stars[i], stars[j]), k},
+                }};
+
+                std::ranges::sort(vertices, std::greater{});
+
+                const float a = vertices[0].first;
+                const float b = vertices[1].first;
+                const float c = vertices[2].first;
+
+                if (c < minTriangleSide)
+                    continue;
+
+                triangles.push_back(Triangle{
+                    .stars = {vertices[0].second, vertices[1].second, vertices[2].second},
+                    .descriptor = {b / a, c / a},
+                });
+            }
+
+    return triangles;
+}
+
+
+export StarField detectStarField(const cv::Mat& gray)
+{
+    auto stars = detectStars(gray);
+    auto triangles = makeTriangles(stars);
+
+    return {std::move(stars), std::move(triangles)};
+}
+
+
+export struct StarMatch
+{
+    cv::Mat transformation;             // 3x3 (CV_32F) similarity transformation of reference field into matched one
+    size_t inliers;                     // stars consistent with transformation
+    size_t matches;                     // stars paired by triangles
+};
+
+
+// Transformation of 'reference' field into 'field', if enough stars could be paired
+export std::optional<StarMatch> matchStarFields(const StarField& reference, const StarField& field)
+{
+    if (reference.triangles.empty() || field.triangles.empty())
+        return {};
+
+    // similar triangles vote for pairs of their vertices
+    cv::Mat votes = cv::Mat::zeros(static_cast<int>(reference.stars.size()), static_cast<int>(field.stars.size()), CV_32S);
+
+    for (const auto& triangle: field.triangles)
+    {
+        const auto nearest = std::ranges::min_element(reference.triangles, {}, [&triangle](const Triangle& candidate)
+        {
+            return cv::norm(candidate.descriptor - triangle.descriptor);
+        });
+
+        if (cv::norm(nearest->descriptor - triangle.descriptor) > maxDescriptorDistance)
+            continue;
+
+        for (size_t v = 0; v < 3; v++)
+            votes.at<int>(static_cast<int>(nearest->stars[v]), static_cast<int>(triangle.stars[v]))++;
+    }
+
+    // star of field is paired with reference star it got most votes with, when the vote is mutual
+    std::vector<cv::Point2f> referencePoints, fieldPoints;
+    for (int f = 0; f < votes.cols; f++)
+    {
+        cv::Point best;
+        double bestVotes = 0;
+        cv::minMaxLoc(votes.col(f), nullptr, &bestVotes, nullptr, &best);
+
+        cv::Point bestField;
+        cv::minMaxLoc(votes.row(best.y), nullptr, nullptr, nullptr, &bestField);
+
+        if (bestVotes >= 2 && bestField.x == f)
+        {
+            referencePoints.push_back(reference.stars[static_cast<size_t>(best.y)]);
+            fieldPoints.push_back(field.stars[static_cast<size_t>(f)]);
+        }
+    }
+
+    if (referencePoints.size() < minMatches)
+        return {};
+
+    cv::Mat inliers;
+    const cv::Mat affine = cv::estimateAffinePartial2D(referencePoints, fieldPoints, inliers, cv::RANSAC, ransacThreshold);
+
+    const auto inliersCount = affine.empty()? 0: static_cast<size_t>(cv::countNonZero(inliers));
+    if (inliersCount < minMatches)
+        return {};
+
+    // same form as homographies found by ECC
+    cv::Mat transformation = cv::Mat::eye(3, 3, CV_32F);
+    cv::Mat affinePart = transformation.rowRange(0, 2);
+    affine.convertTo(affinePart, CV_32F);
+
+    return StarMatch{
+        .transformation = transformation,
+        .inliers = inliersCount,
+        .matches = referencePoints.size(),
+    };
+}
@@ -0,0 +1,344 @@
+module;
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+export module task_pool;
+
+
+namespace Utils
+{
+    // Pool of threads with a task queue per thread.
+    // Idle threads steal tasks from other queues. Threads waiting for a group of tasks execute its tasks which
+    // were not started yet (see TaskGroup), so tasks may safely create and wait for nested tasks.
+    export class TaskPool
+    {
+    public:
+        using Task = std::function<void()>;
+
+        // 'threads' is the total parallelism: pool starts threads - 1 workers as thread waiting for tasks also executes them
+        explicit TaskPool(size_t threads)
+            : m_threads(std::max<size_t>(threads, 1))
+        {
+            const size_t workers = m_threads - 1;
+
+            for (size_t i = 0; i < std::max<size_t>(workers, 1); i++)
+                m_queues.push_back(std::make_unique<Queue>());
+
+            for (size_t i = 0; i < workers; i++)
+                m_workers.emplace_back([this, i]
+                {
+                    work(i);
+                });
+        }
+
+        TaskPool(const TaskPool &) = delete;
+        TaskPool& operator=(const TaskPool &) = delete;
+
+        ~TaskPool()
+        {
+            {
+                std::lock_guard lock(m_sleepMutex);
+                m_stop = true;
+            }
+
+            m_wakeUp.notify_all();
+            m_workers.clear();
+        }
+
+        void submit(Task task)
+        {
+            // counted before task is published, so taking it never finds counter at zero
+            {
+                std::lock_guard lock(m_sleepMutex);
+                m_pending++;
+            }
+
+            if (currentPool == this)
+            {
+                // nested task - keep it close to its parent (depth first)
+                auto& queue = *m_queues[currentQueue];
+                std::lock_guard lock(queue.mutex);
+                queue.tasks.push_front(std::move(task));
+            }
+            else
+            {
+                auto& queue = *m_queues[m_nextQueue++ % m_queues.size()];
+                std::lock_guard lock(queue.mutex);
+                queue.tasks.push_back(std::move(task));
+            }
+
+            m_wakeUp.notify_one();
+        }
+
+        size_t threads() const
+        {
+            return m_threads;
+        }
+
+        // Global pool. setGlobalThreads() needs to be called before first use of global() to take effect.
+        static TaskPool& global()
+        {
+            static TaskPool pool(globalThreads.load());
+            return pool;
+        }
+
+        static void setGlobalThreads(size_t threads)
+        {
+            globalThreads = threads;
+        }
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        static inline std::atomic<size_t> globalThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        static inline thread_local const TaskPool* currentPool = nullptr;
+        static inline thread_local size_t currentQueue = 0;
+
+        std::vector<std::unique_ptr<Queue>> m_queues;
+        std::vector<std::jthread> m_workers;
+        std::mutex m_sleepMutex;
+        std::condition_variable m_wakeUp;
+        std::atomic<size_t> m_pending = 0;
+        std::atomic<size_t> m_nextQueue = 0;
+        const size_t m_threads;
+        bool m_stop = false;
+
+        std::optional<Task> take(size_t ownQueue)
+        {
+            const size_t queues = m_queues.size();
+
+            for (size_t i = 0; i < queues; i++)
+            {
+                const size_t queueIdx = (ownQueue + i) % queues;
+                auto& queue = *m_queues[queueIdx];
+
+                std::lock_guard lock(queue.mutex);
+                if (queue.tasks.empty())
+                    continue;
+
+                // take own tasks from the front, steal from the back
+                Task task;
+                if (i == 0)
+                {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                else
+                {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                }
+
+                m_pending--;
+                return task;
+            }
+
+            return {};
+        }
+
+        void work(size_t queue)
+        {
+            currentPool = this;
+            currentQueue = queue;
+
+            while (true)
+            {
+                if (auto task = take(queue))
+                {
+                    (*task)();
+                    continue;
+                }
+
+                std::unique_lock lock(m_sleepMutex);
+                m_wakeUp.wait(lock, [this]
+                {
+                    return m_stop || m_pending > 0;
+                });
+
+                if (m_stop && m_pending == 0)
+                    break;
+            }
+        }
+    };
+
+
+    // Set of tasks which can be waited for.
+    // Waiting thread executes group's tasks not started yet by pool, but never tasks of others, so waiting for a group
+    // does not take longer than the group itself. First exception thrown by any task cancels tasks not started yet and is rethrown by wait().
+    export class TaskGroup
+    {
+    public:
+        explicit TaskGroup(TaskPool& pool = TaskPool::global())
+            : m_pool(pool)
+        {
+
+        }
+
+        TaskGroup(const TaskGroup &) = delete;
+        TaskGroup& operator=(const TaskGroup &) = delete;
+
+        ~TaskGroup()
+        {
+            waitForAll();
+        }
+
+        template<typename F>
+        void run(F&& f)
+        {
+            run(m_pool, std::forward<F>(f));
+        }
+
+        // run task in other pool. Waiting thread still executes it when the pool did not start it yet
+        template<typename F>
+        void run(TaskPool& pool, F&& f)
+        {
+            // task is executed by pool or by waiting thread, whichever claims it first
+            auto task = std::make_shared<PendingTask>();
+            task->f = [this, f = std::forward<F>(f)]() mutable
+            {
+                if (m_cancelled == false)
+                {
+                    try
+                    {
+                        f();
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard lock(m_mutex);
+
+                        if (m_exception == nullptr)
+                            m_exception = std::current_exception();
+
+                        m_cancelled = true;
+                    }
+                }
+
+                // group may be destroyed as soon as waiting thread sees m_running == 0, so notify under lock
+                std::lock_guard lock(m_mutex);
+                m_running--;
+                m_finished.notify_all();
+            };
+
+            {
+                std::lock_guard lock(m_mutex);
+                m_running++;
+                m_pending.push_back(task);
+            }
+
+            m_finished.notify_all();
+
+            // pool without workers would only collect executed tasks
+            if (pool.threads() == 1)
+                return;
+
+            // pool's copy does not refer to the group, which may be gone when task was executed by waiting thread
+            pool.submit([task]
+            {
+                execute(*task);
+            });
+        }
+
+        void cancel()
+        {
+            m_cancelled = true;
+        }
+
+        bool cancelled() const
+        {
+            return m_cancelled;
+        }
+
+        void wait()
+        {
+            waitForAll();
+
+            std::lock_guard lock(m_mutex);
+            if (m_exception)
+                std::rethrow_exception(std::exchange(m_exception, nullptr));
+        }
+
+        // Execute one of group's tasks not started yet (if any) in the calling thread
+        bool runPending()
+        {
+            std::shared_ptr<PendingTask> task;
+
+            {
+                std::lock_guard lock(m_mutex);
+
+                while (m_pending.empty() == false && task == nullptr)
+                {
+                    auto next = std::move(m_pending.front());
+                    m_pending.pop_front();
+
+                    if (next->claimed == false)
+                        task = std::move(next);
+                }
+            }
+
+            return task != nullptr && execute(*task);
+        }
+
+    private:
+        struct PendingTask
+        {
+            std::atomic<bool> claimed = false;
+            std::function<void()> f;
+        };
+
+        TaskPool& m_pool;
+        std::mutex m_mutex;
+        std::condition_variable m_finished;
+        std::exception_ptr m_exception;
+        std::atomic<bool> m_cancelled = false;
+        std::deque<std::shared_ptr<PendingTask>> m_pending;        // in order of submission, some may be already claimed by pool
+        size_t m_running = 0;
+
+        static bool execute(PendingTask& task)
+        {
+            if (task.claimed.exchange(true))
+                return false;
+
+            // captures are released as soon as task is done, even if its pool's entry lives longer
+            auto f = std::move(task.f);
+            f();
+
+            return true;
+        }
+
+        void waitForAll()
+        {
+            while (true)
+            {
+                // execute own tasks instead of blocking a thread
+                if (runPending())
+                    continue;
+
+                // woken up when task finishes or a new one is added (tasks may add nested ones)
+                std::unique_lock lock(m_mutex);
+                m_finished.wait(lock, [this]
+                {
+                    return m_running == 0 || m_pending.empty() == false;
+                });
+
+                if (m_running == 0)
+                    break;
+            }
+        }
+    };
+}
@@ -71,7 +71,7 @@ class TestAstroStacker(unittest.TestCase):
             self.assertEqual(code, 0);
 
             chksums = calculate_checksums(temp_dir)
-            self.assertEqual(len(chksums), 244)
+            self.assertEqual(len(chksums), 184)
             self.assertTrue(os.path.isfile(input_file))
 
             pure_run_chksums = set(self.all_chksums.values())
@@ -85,7 +85,7 @@ class TestAstroStacker(unittest.TestCase):
             self.assertEqual(code, 0);
 
             chksums = calculate_checksums(temp_dir)
-            self.assertEqual(len(chksums), 260)
+            self.assertEqual(len(chksums), 200)
             self.assertTrue(os.path.isfile(input_file))
 
             # compare results but remove elements which will be different
@@ -101,7 +101,7 @@ class TestAstroStacker(unittest.TestCase):
 
             # expect less files than in test_split_option
             chksums = calculate_checksums(temp_dir)
-            self.assertEqual(len(chksums), 176)
+            self.assertEqual(len(chksums), 136)
             self.assertTrue(os.path.isfile(input_file))
 
     def test_noop_crop_option(self):
@@ -111,10 +111,10 @@ class TestAstroStacker(unittest.TestCase):
             self.assertEqual(code, 0);
 
             chksums = calculate_checksums(temp_dir)
-            self.assertEqual(len(chksums), 304)
+            self.assertEqual(len(chksums), 184)
             self.assertTrue(os.path.isfile(input_file))
 
-            # cropped set has more images (crop step) but they should be duplicates of images from previous set, so set() should remove them as duplicates
+            # crop is applied while frames are acquired, so there is no extra step and images should be the same as without crop
             pure_run_chksums = set(self.all_chksums.values())
             base_run_chksums = set(chksums.values())
             self.assertEqual(pure_run_chksums, base_run_chksums)
@@ -126,18 +126,45 @@ class TestAstroStacker(unittest.TestCase):
             self.assertEqual(code, 0);
 
             chksums = calculate_checksums(temp_dir)
-            self.assertEqual(len(chksums), 304)
+            self.assertEqual(len(chksums), 184)
             self.assertTrue(os.path.isfile(input_file))
 
             pure_run_chksums = set(self.all_chksums.values())
             base_run_chksums = set(chksums.values())
             self.assertNotEqual(pure_run_chksums, base_run_chksums)
 
+    def test_sliding_window_option(self):
+        with tempfile.TemporaryDirectory() as temp_dir:
+            input_file = "video-files/moon.mp4"
+            stdout, stderr, code = run_application(self.AS_PATH, f"--working-dir {temp_dir} --sliding-window 20,10 {input_file}")
+            self.assertEqual(code, 0);
+
+            # each window gives average and median stack
+            chksums = calculate_checksums(temp_dir)
+            enhanced = [file for file in chksums.keys() if "enhanced" in file]
+            self.assertGreater(len(enhanced), 2)
+            self.assertEqual(len(enhanced) % 2, 0)
+
+    def test_in_memory_option(self):
+        with tempfile.TemporaryDirectory() as temp_dir:
+            input_file = "video-files/moon.mp4"
+            stdout, stderr, code = run_application(self.AS_PATH, f"--working-dir {temp_dir} --in-memory {input_file}")
+            self.assertEqual(code, 0);
+
+            # only final images are written, and they are the same as in regular run
+            chksums = calculate_checksums(temp_dir)
+            self.assertGreater(len(chksums), 0)
+            self.assertTrue(all("enhanced" in file for file in chksums.keys()))
+
+            pure_run_chksums = set(self.all_chksums.values())
+            memory_run_chksums = set(chksums.values())
+            self.assertTrue(memory_run_chksums.issubset(pure_run_chksums))
+
     def test_dir_as_input(self):
         with tempfile.TemporaryDirectory() as temp_dir:
-            # export images from video
+            # export whole frames from video (object is otherwise extracted while frames are acquired)
             input_file = "video-files/moon.mp4"
-            stdout, stderr, code = run_application(self.AS_PATH, f"--working-dir {temp_dir}/1 --stop-after 1 {input_file}")
+            stdout, stderr, code = run_application(self.AS_PATH, f"--working-dir {temp_dir}/1 --stop-after 1 --disable-object-detection {input_file}")
             self.assertEqual(code, 0);
 
             input_file = f"{temp_dir}/1"
@@ -147,13 +174,34 @@ class TestAstroStacker(unittest.TestCase):
 
             # procesing images should give the same result as processing video
             chksums = calculate_checksums(f"{temp_dir}/2")
-            self.assertEqual(len(chksums), 244)
+            self.assertEqual(len(chksums), 184)
             self.assertTrue(os.path.isdir(input_file))
 
             pure_run_chksums = set(self.all_chksums.values())
             base_run_chksums = set(chksums.values())
             self.assertEqual(pure_run_chksums, base_run_chksums)
 
+    def test_rerun_with_metadata(self):
+        with tempfile.TemporaryDirectory() as temp_dir:
+            input_file = "video-files/moon.mp4"
+            stdout, stderr, code = run_application(self.AS_PATH, f"--working-dir {temp_dir}/1 --save-metadata {input_file}")
+            self.assertEqual(code, 0);
+
+            # working directory of previous run has its time stamp
+            previous_wd = os.path.join(f"{temp_dir}/1", os.listdir(f"{temp_dir}/1")[0])
+            self.assertTrue(os.path.isfile(os.path.join(previous_wd, "metadata.bin")))
+
+            stdout, stderr, code = run_application(self.AS_PATH, f"--working-dir {temp_dir}/2 --load-metadata {previous_wd} {input_file}")
+            self.assertEqual(code, 0);
+
+            # frames are not scored again, and results are the same
+            output = stdout + stderr
+            self.assertIn("Loaded frame metadata of previous run", output)
+            self.assertIn("Scores of 60 of 60 images reused from frame metadata", output)
+
+            chksums = calculate_checksums(f"{temp_dir}/2")
+            self.assertEqual(set(self.all_chksums.values()), set(chksums.values()))
+
 def main(app_path):
     if len(app_path) == 0 or os.path.isfile(app_path) == False:
         raise Exception(f"Path to astro-stacker executable is invalid. File: '{app_path}' does not exists.")
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <opencv2/opencv.hpp>
+
+import aberration_fixer;
+
+
+namespace
+{
+    // smooth blobs, so shifting by a fraction of pixel is well defined
+    cv::Mat blobs()
+    {
+        cv::Mat image(128, 128, CV_32FC1, cv::Scalar(0));
+
+        const cv::Point2f centers[] = { {40, 45}, {85, 38}, {62, 70}, {35, 92}, {90, 88} };
+        for (const auto& center: centers)
+            for (int y = 0; y < image.rows; y++)
+                for (int x = 0; x < image.cols; x++)
+                {
+                    const float dx = x - center.x;
+                    const float dy = y - center.y;
+                    image.at<float>(y, x) += 50000.0f * std::exp(-(dx * dx + dy * dy) / (2 * 4.0f * 4.0f));
+                }
+
+        cv::Mat image16;
+        image.convertTo(image16, CV_16UC1);
+        return image16;
+    }
+
+    cv::Mat shifted(const cv::Mat& image, double dx, double dy)
+    {
+        const cv::Mat translation = (cv::Mat_<double>(2, 3) << 1, 0, dx, 0, 1, dy);
+
+        cv::Mat result;
+        cv::warpAffine(image, result, translation, image.size(), cv::INTER_CUBIC, cv::BORDER_REPLICATE);
+        return result;
+    }
+
+    double meanDifference(const cv::Mat& a, const cv::Mat& b)
+    {
+        // borders are filled by replication, compare interior only
+        const cv::Rect interior(16, 16, a.cols - 32, a.rows - 32);
+        return cv::norm(a(interior), b(interior), cv::NORM_L1) / interior.area();
+    }
+}
+
+
+TEST(ShiftChannelTest, subPixelShiftIsRecoveredAndCorrected)
+{
+    const cv::Mat reference = blobs();
+    const cv::Mat channel = shifted(reference, 1.4, -0.7);
+
+    cv::Mat aligned;
+    const cv::Matx33d transform = shiftChannel(reference, channel, aligned);
+
+    EXPECT_NEAR(transform(0, 2), -1.4, 0.1);
+    EXPECT_NEAR(transform(1, 2), 0.7, 0.1);
+
+    ASSERT_EQ(aligned.type(), reference.type());
+    ASSERT_EQ(aligned.size(), reference.size());
+
+    // channel after correction is much closer to reference than it was
+    const double before = meanDifference(reference, channel);
+    const double after = meanDifference(reference, aligned);
+    EXPECT_LT(after, before / 4);
+}
+
+
+TEST(ShiftChannelTest, alignedChannelIsNotMoved)
+{
+    const cv::Mat reference = blobs();
+
+    cv::Mat aligned;
+    const cv::Matx33d transform = shiftChannel(reference, reference, aligned);
+
+    EXPECT_NEAR(transform(0, 2), 0.0, 0.05);
+    EXPECT_NEAR(transform(1, 2), 0.0, 0.05);
+}
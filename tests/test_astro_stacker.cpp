@@ -0,0 +1,41 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+import astro_stacker;
+import utils;
+
+
+TEST(AstroStackerTest, stacksFramesInMemory)
+{
+    std::vector<cv::Mat> frames;
+    for (int i = 0; i < 8; i++)
+    {
+        cv::Mat frame = cv::Mat::zeros(128, 128, CV_8UC1);
+        cv::circle(frame, cv::Point(64, 64), 30, cv::Scalar(200), cv::FILLED);
+        cv::GaussianBlur(frame, frame, cv::Size(0, 0), 2.0);
+
+        cv::Mat noise(frame.size(), CV_8UC1);
+        cv::randu(noise, 0, 10);
+        frames.push_back(frame + noise);
+    }
+
+    const auto* activeFileManager = &Utils::fileManager();
+
+    AstroStacker::Stacker stacker(PipelineOptions{.objectDetection = ObjectDetection::None});
+    const auto stacks = stacker.stack(frames);
+
+    // stacker's storage is used for its own directories only
+    EXPECT_EQ(&Utils::fileManager(), activeFileManager);
+
+    ASSERT_EQ(stacks.size(), 1);
+
+    for (const auto& image: {stacks.front().average, stacks.front().median})
+    {
+        EXPECT_GE(image.cols, 120);         // aligned frames may be cropped to their common part
+        EXPECT_GE(image.rows, 120);
+        EXPECT_EQ(image.type(), CV_8UC1);
+        EXPECT_GT(image.at<uchar>(64, 64), 150);
+    }
+}
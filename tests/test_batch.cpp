@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+import batch;
+
+using testing::ElementsAre;
+using testing::UnorderedElementsAre;
+
+
+TEST(JobNamesTest, namesFollowInputs)
+{
+    const std::vector<std::filesystem::path> inputs = {"/videos/jupiter.ser", "/videos/saturn.mp4", "/frames/moon/"};
+
+    EXPECT_THAT(jobNames(inputs), ElementsAre("jupiter", "saturn", "moon"));
+}
+
+
+TEST(JobNamesTest, sameNamedInputsGetUniqueNames)
+{
+    // last input is named like the suffixed second one
+    const std::vector<std::filesystem::path> inputs = {"/day1/jupiter.ser", "/day2/jupiter.ser", "/day3/jupiter.mp4", "/day4/jupiter-2.ser"};
+
+    const auto names = jobNames(inputs);
+    ASSERT_EQ(names.size(), inputs.size());
+    EXPECT_EQ(names[0], "jupiter");
+    EXPECT_EQ(std::set(names.begin(), names.end()).size(), inputs.size());
+}
+
+
+TEST(ProcessBatchTest, failingInputDoesNotStopOthers)
+{
+    const std::vector<std::filesystem::path> inputs = {"a.ser", "b.ser", "broken.ser", "c.ser", "d.ser"};
+
+    for (const size_t parallelJobs: {1, 2, 8})
+    {
+        std::mutex mutex;
+        std::vector<std::string> processed;
+
+        const auto failed = processBatch(inputs, parallelJobs, [&](const std::filesystem::path& input, const std::string& name)
+        {
+            if (input == "broken.ser")
+                throw std::runtime_error("broken input");
+
+            std::lock_guard lock(mutex);
+            processed.push_back(name);
+        });
+
+        EXPECT_EQ(failed, 1);
+        EXPECT_THAT(processed, UnorderedElementsAre("a", "b", "c", "d"));
+    }
+}
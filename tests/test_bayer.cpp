@@ -0,0 +1,34 @@
+#include <gtest/gtest.h>
+
+#include <opencv2/opencv.hpp>
+
+import bayer;
+
+
+TEST(BayerTest, patternNames)
+{
+    EXPECT_EQ(readBayerPattern("RGGB"), BayerPattern::RGGB);
+    EXPECT_EQ(readBayerPattern("gbrg"), BayerPattern::GBRG);
+    EXPECT_FALSE(readBayerPattern("RGB"));
+}
+
+
+TEST(BayerTest, splitAndMergeAreInverse)
+{
+    cv::Mat mosaic(6, 8, CV_8UC1);
+    cv::randu(mosaic, 0, 256);
+
+    const auto planes = splitCfa(mosaic);
+    EXPECT_EQ(planes[0].size(), cv::Size(4, 3));
+    EXPECT_EQ(planes[3].at<uchar>(2, 3), mosaic.at<uchar>(5, 7));
+
+    const cv::Mat merged = mergeCfa(planes);
+    EXPECT_EQ(cv::countNonZero(merged != mosaic), 0);
+}
+
+
+TEST(BayerTest, regionIsAlignedToCells)
+{
+    EXPECT_EQ(alignToCfa(cv::Rect(3, 5, 10, 7)), cv::Rect(2, 4, 10, 8));
+    EXPECT_EQ(alignToCfa(cv::Rect(2, 4, 5, 5)), cv::Rect(2, 4, 4, 4));
+}
@@ -6,7 +6,9 @@
 #include <ranges>
 #include <string>
 
+import aberration_fixer;
 import config;
+import images_aligner;
 import images_picker;
 import utils;
 
@@ -23,13 +25,55 @@ TEST(ConfigTest, defaults)
 
     EXPECT_FALSE(config.crop.has_value());
     EXPECT_TRUE(config.doObjectDetection);
+    EXPECT_FALSE(config.objectTracking);
     EXPECT_THAT(config.inputFiles, Contains("input_file.mp4"));
     EXPECT_TRUE(std::holds_alternative<MedianPicker>(config.pickerMethod));
+    EXPECT_EQ(config.chromaMethod, ChromaticAberrationMethod::Homography);
+    EXPECT_EQ(config.alignmentMethod, AlignmentMethod::Ecc);
+    EXPECT_EQ(config.colorMode, Config::ColorMode::Auto);
     EXPECT_EQ(config.skip, 0);
+    EXPECT_EQ(config.queueDepth, 0);
+    EXPECT_EQ(config.parallelJobs, 2);
+    EXPECT_EQ(config.progressInterval.count(), 0);
+    EXPECT_EQ(config.alignMaxIterations, 5000);
+    EXPECT_EQ(config.alignTimeBudget.count(), 0);
     EXPECT_FALSE(config.split.has_value());
     EXPECT_TRUE(config.wd.string().starts_with("somedir"));
 }
 
+TEST(ConfigTest, multipleInputs)
+{
+    std::vector<std::string> argv_str = {"test.bin", "--working-dir", "somedir", "--parallel-jobs", "4", "first.mp4", "second.avi"};
+    auto argv_view = argv_str | std::views::transform([](std::string& str) { return str.data(); });
+    std::vector<char *> argv(argv_view.begin(), argv_view.end());
+
+    const auto config = Config::readParams(argv.size(), &argv[0]);
+
+    EXPECT_EQ(config.inputFiles.size(), 2);
+    EXPECT_THAT(config.inputFiles, Contains("first.mp4"));
+    EXPECT_THAT(config.inputFiles, Contains("second.avi"));
+    EXPECT_EQ(config.parallelJobs, 4);
+}
+
+TEST(ConfigTest, daemonWithoutInputs)
+{
+    const auto config = Config::readParams(std::vector<std::string>{"--working-dir", "somedir", "--daemon", "spool"});
+
+    ASSERT_TRUE(config.daemonSpool.has_value());
+    EXPECT_EQ(*config.daemonSpool, "spool");
+    EXPECT_TRUE(config.inputFiles.empty());
+    EXPECT_EQ(config.priority, 0);
+}
+
+TEST(ConfigTest, jobArguments)
+{
+    const auto config = Config::readParams(std::vector<std::string>{"--working-dir", "somedir", "--priority", "5", "capture.ser"});
+
+    EXPECT_FALSE(config.daemonSpool.has_value());
+    EXPECT_THAT(config.inputFiles, Contains("capture.ser"));
+    EXPECT_EQ(config.priority, 5);
+}
+
 using CropParam = std::tuple<std::string_view, int, int, int, int>;
 
 class CropParserTest: public testing::TestWithParam<CropParam> { };
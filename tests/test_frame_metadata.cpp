@@ -0,0 +1,81 @@
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <memory>
+#include <opencv2/opencv.hpp>
+
+import frame_metadata;
+
+
+TEST(FrameMetadataTest, savedMetadataCanBeLoaded)
+{
+    const auto file = std::filesystem::temp_directory_path() / "astro-stacker-metadata-test.bin";
+
+    FrameMetadata metadata;
+    metadata.update("moon.mp4-1", [](FrameRecord& record)
+    {
+        record.size = cv::Size(640, 480);
+        record.score = 12.5;
+        record.transform = cv::Matx33d(1, 0, 2.5, 0, 1, -3.25, 0, 0, 1);
+    });
+
+    metadata.update("moon.mp4-2", [](FrameRecord& record)
+    {
+        record.object = cv::Rect(10, 20, 30, 40);
+    });
+
+    metadata.save(file);
+
+    FrameMetadata loaded;
+    loaded.load(file);
+    std::filesystem::remove(file);
+
+    const auto first = loaded.find("moon.mp4-1");
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(first->size, cv::Size(640, 480));
+    EXPECT_EQ(first->score, 12.5);
+    ASSERT_TRUE(first->transform.has_value());
+    EXPECT_EQ((*first->transform)(0, 2), 2.5);
+    EXPECT_EQ((*first->transform)(1, 2), -3.25);
+    EXPECT_FALSE(first->object.has_value());
+    EXPECT_FALSE(first->timestamp.has_value());
+
+    const auto second = loaded.find("moon.mp4-2");
+    ASSERT_TRUE(second.has_value());
+    EXPECT_EQ(second->object, cv::Rect(10, 20, 30, 40));
+    EXPECT_FALSE(second->score.has_value());
+}
+
+
+TEST(FrameMetadataTest, metadataIsFoundByImagePath)
+{
+    const auto metadata = std::make_shared<FrameMetadata>();
+    const FrameMetadataRegistration registration("/wd/run", metadata);
+
+    updateFrameMetadata("/wd/run/#1 images/moon.mp4-7.png", [](FrameRecord& record)
+    {
+        record.score = 1.0;
+    });
+
+    // the same frame in other step's directory
+    const auto record = frameRecord("/wd/run/#3 chroma/moon.mp4-7.png");
+    ASSERT_TRUE(record.has_value());
+    EXPECT_EQ(record->score, 1.0);
+
+    EXPECT_FALSE(frameRecord("/wd/other run/#1 images/moon.mp4-7.png").has_value());
+}
+
+
+TEST(FrameMetadataTest, mostNestedDirectoryWins)
+{
+    const auto outer = std::make_shared<FrameMetadata>();
+    const auto inner = std::make_shared<FrameMetadata>();
+    const FrameMetadataRegistration outerRegistration("/wd", outer);
+    const FrameMetadataRegistration innerRegistration("/wd/job", inner);
+
+    EXPECT_EQ(frameMetadata("/wd/job/#1 images/moon.mp4-7.png"), inner);
+    EXPECT_EQ(frameMetadata("/wd/other job/#1 images/moon.mp4-7.png"), outer);
+    EXPECT_EQ(frameMetadata("/wd"), outer);
+    EXPECT_EQ(frameMetadata("/other/moon.mp4-7.png"), nullptr);
+}
@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <format>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+import frame_metadata;
+import images_aligner;
+import memory_file_manager;
+import utils;
+
+
+namespace
+{
+    // smooth random pattern, so ECC has gradients to follow
+    cv::Mat pattern(int size)
+    {
+        cv::Mat image(size, size, CV_8UC1);
+        cv::randu(image, 0, 256);
+        cv::GaussianBlur(image, image, cv::Size(0, 0), 4.0);
+        cv::normalize(image, image, 0, 255, cv::NORM_MINMAX);
+
+        return image;
+    }
+
+    cv::Mat shifted(const cv::Mat& image, float dx, float dy)
+    {
+        const cv::Mat translation = (cv::Mat_<float>(2, 3) << 1, 0, dx, 0, 1, dy);
+
+        cv::Mat result;
+        cv::warpAffine(image, result, translation, image.size(), cv::INTER_LINEAR, cv::BORDER_REFLECT);
+
+        return result;
+    }
+
+    std::vector<std::filesystem::path> storeFrames(MemoryFileManager& files, const std::filesystem::path& dir, const std::vector<cv::Mat>& frames)
+    {
+        std::vector<std::filesystem::path> paths;
+
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            paths.push_back(dir / std::format("{}.png", i));
+            files.add(paths.back(), frames[i]);
+        }
+
+        return paths;
+    }
+}
+
+
+TEST(ImagesAlignerTest, shiftedFrameConverges)
+{
+    const cv::Mat reference = pattern(256);
+
+    const auto result = findTransformation(reference, shifted(reference, 3, -2));
+
+    EXPECT_EQ(result.status, AlignmentStatus::Converged);
+    ASSERT_FALSE(result.transformation.empty());
+    EXPECT_NEAR(std::abs(result.transformation.at<float>(0, 2)), 3.0, 0.5);
+    EXPECT_NEAR(std::abs(result.transformation.at<float>(1, 2)), 2.0, 0.5);
+}
+
+
+TEST(ImagesAlignerTest, uncorrelatedFrameFailsWithoutThrowing)
+{
+    const cv::Mat reference = pattern(256);
+    const cv::Mat inverted = 255 - reference;
+
+    EccResult result;
+    EXPECT_NO_THROW(result = findTransformation(reference, inverted));
+
+    EXPECT_EQ(result.status, AlignmentStatus::Failed);
+    EXPECT_TRUE(result.transformation.empty());
+}
+
+
+TEST(ImagesAlignerTest, timeBudgetStopsSearch)
+{
+    const cv::Mat reference = pattern(512);
+
+    // with eps = 0 ECC never converges by itself, so the budget ends search after the first round
+    const EccOptions options {
+        .timeBudget = std::chrono::milliseconds(1),
+        .eps = 0.0,
+    };
+
+    const auto result = findTransformation(reference, shifted(reference, 3, -2), options);
+
+    EXPECT_EQ(result.status, AlignmentStatus::TimeLimit);
+}
+
+
+TEST(ImagesAlignerTest, framesOutOfTimeBudgetAreRejected)
+{
+    MemoryFileManager files;
+    const std::filesystem::path dir = "aligner-time-test";
+    const Utils::FileManagerRegistration registration(dir, files);
+
+    const cv::Mat reference = pattern(512);
+    const auto frames = storeFrames(files, dir / "input", {reference, shifted(reference, 3, -2)});
+
+    const AlignmentOptions options {
+        .ecc = {
+            .timeBudget = std::chrono::milliseconds(1),
+            .eps = 0.0,
+        },
+    };
+
+    const auto aligned = alignImages(dir / "aligned", frames, options);
+
+    // only reference is left
+    ASSERT_EQ(aligned.size(), 1);
+    EXPECT_EQ(aligned.front().filename(), "0.png");
+}
+
+
+TEST(ImagesAlignerTest, alignImagesDropsRejectedFrames)
+{
+    MemoryFileManager files;
+    const std::filesystem::path dir = "aligner-rejection-test";
+    const Utils::FileManagerRegistration registration(dir, files);
+
+    const cv::Mat reference = pattern(256);
+    const auto frames = storeFrames(files, dir / "input", {reference, shifted(reference, 3, -2), 255 - reference, shifted(reference, -1, 2)});
+
+    const auto aligned = alignImages(dir / "aligned", frames);
+
+    ASSERT_EQ(aligned.size(), 3);
+    EXPECT_EQ(aligned[0].filename(), "0.png");
+    EXPECT_EQ(aligned[1].filename(), "1.png");
+    EXPECT_EQ(aligned[2].filename(), "3.png");
+
+    // aligned frames are cropped to common region
+    const cv::Mat first = files.read(aligned[0], cv::IMREAD_UNCHANGED);
+    EXPECT_LT(first.cols, 256);
+}
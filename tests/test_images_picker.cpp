@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+import frame_metadata;
+import images_picker;
+import memory_file_manager;
+import utils;
+
+
+TEST(ScoreImagesTest, savedScoresAreReused)
+{
+    const std::filesystem::path dir = "/non-existing-dir/picker";
+    MemoryFileManager files;
+    const Utils::FileManagerRegistration fileManagerRegistration(dir, files);
+
+    // metadata as loaded from previous run
+    FrameMetadata previous;
+    previous.update("1", [](FrameRecord& record) { record.score = 3.0; });
+    previous.update("2", [](FrameRecord& record) { record.score = 5.0; });
+    previous.save(std::filesystem::temp_directory_path() / "picker-metadata.bin");
+
+    const auto metadata = std::make_shared<FrameMetadata>();
+    metadata->load(std::filesystem::temp_directory_path() / "picker-metadata.bin");
+    std::filesystem::remove(std::filesystem::temp_directory_path() / "picker-metadata.bin");
+    const FrameMetadataRegistration metadataRegistration(dir, metadata);
+
+    // only frame without saved score is read and scored
+    cv::Mat frame(32, 32, CV_8UC1);
+    cv::randu(frame, 0, 255);
+    files.add(dir / "#1 chroma" / "3.png", frame);
+
+    const std::vector<std::filesystem::path> images = {dir / "#1 chroma" / "1.png", dir / "#1 chroma" / "2.png", dir / "#1 chroma" / "3.png"};
+    const auto scores = scoreImages(images);
+
+    ASSERT_EQ(scores.size(), 3);
+    EXPECT_EQ(scores[0], 3.0);
+    EXPECT_EQ(scores[1], 5.0);
+    EXPECT_GT(scores[2], 0.0);
+    EXPECT_EQ(metadata->find("3")->score, scores[2]);
+}
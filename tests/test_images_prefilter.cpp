@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+import frame_metadata;
+import images_prefilter;
+import memory_file_manager;
+import utils;
+
+
+namespace
+{
+    const std::filesystem::path dir = "/non-existing-dir/prefilter";
+
+    // disk of given brightness on noisy dark background
+    cv::Mat frame(double brightness, int seed)
+    {
+        cv::Mat image(256, 256, CV_8UC1);
+        cv::theRNG().state = seed;
+        cv::randu(image, 0, 8);
+        cv::circle(image, cv::Point(128, 128), 60, cv::Scalar(brightness), cv::FILLED);
+
+        return image;
+    }
+
+    cv::Mat deep(const cv::Mat& image)
+    {
+        cv::Mat result;
+        image.convertTo(result, CV_16U, 257);
+        return result;
+    }
+
+    struct Prefiltered
+    {
+        std::vector<std::string> accepted;
+        std::vector<std::optional<FrameRejection>> rejections;
+    };
+
+    Prefiltered prefilter(const std::vector<cv::Mat>& frames)
+    {
+        MemoryFileManager files;
+        const Utils::FileManagerRegistration fileManagerRegistration(dir, files);
+
+        const auto metadata = std::make_shared<FrameMetadata>();
+        const FrameMetadataRegistration metadataRegistration(dir, metadata);
+
+        std::vector<std::filesystem::path> paths;
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            paths.push_back(dir / "frames" / std::format("{}.png", i));
+            files.add(paths.back(), frames[i]);
+        }
+
+        Prefiltered result;
+        for (const auto& path: prefilterImages(dir / "prefiltered", paths))
+            result.accepted.push_back(path.stem().string());
+
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            const auto record = metadata->find(std::to_string(i));
+            result.rejections.push_back(record? record->rejection: std::nullopt);
+        }
+
+        return result;
+    }
+}
+
+
+TEST(PrefilterTest, unusableFramesAreRejected)
+{
+    const auto result = prefilter({
+        frame(150, 1),
+        cv::Mat::zeros(256, 256, CV_8UC1),      // no object
+        frame(255, 2),                          // saturated object
+        frame(50, 3),                           // clouded
+        frame(150, 4),
+    });
+
+    EXPECT_EQ(result.accepted, (std::vector<std::string>{"0", "4"}));
+    EXPECT_EQ(result.rejections[1], FrameRejection::Empty);
+    EXPECT_EQ(result.rejections[2], FrameRejection::Clipped);
+    EXPECT_EQ(result.rejections[3], FrameRejection::Clouded);
+}
+
+
+TEST(PrefilterTest, deepFramesAreRejectedLikeEightBitOnes)
+{
+    const auto result = prefilter({
+        deep(frame(150, 1)),
+        deep(cv::Mat::zeros(256, 256, CV_8UC1)),
+        deep(frame(255, 2)),
+        deep(frame(50, 3)),
+        deep(frame(150, 4)),
+    });
+
+    EXPECT_EQ(result.accepted, (std::vector<std::string>{"0", "4"}));
+    EXPECT_EQ(result.rejections[1], FrameRejection::Empty);
+    EXPECT_EQ(result.rejections[2], FrameRejection::Clipped);
+    EXPECT_EQ(result.rejections[3], FrameRejection::Clouded);
+}
+
+
+TEST(PrefilterTest, onlyExactDuplicatesAreRejected)
+{
+    const auto steady = frame(150, 1);
+
+    // steady object with slightly different noise, as in frames of well tracked target
+    cv::Mat nextSteady = steady.clone();
+    nextSteady.at<uchar>(10, 10) += 1;
+    nextSteady.at<uchar>(200, 30) += 1;
+
+    const auto result = prefilter({steady, steady.clone(), nextSteady});
+
+    EXPECT_EQ(result.accepted, (std::vector<std::string>{"0", "2"}));
+    EXPECT_EQ(result.rejections[1], FrameRejection::Duplicate);
+    EXPECT_FALSE(result.rejections[2].has_value());
+}
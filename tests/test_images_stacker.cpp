@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <format>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+import images_stacker;
+import memory_file_manager;
+import utils;
+
+
+namespace
+{
+    const std::filesystem::path dir = "/non-existing-dir/stacker";
+
+    std::vector<std::filesystem::path> storeFrames(MemoryFileManager& files, const std::vector<cv::Mat>& frames)
+    {
+        std::vector<std::filesystem::path> paths;
+
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            paths.push_back(dir / std::format("{}.png", i));
+            files.add(paths.back(), frames[i]);
+        }
+
+        return paths;
+    }
+}
+
+
+TEST(MedianStackingTest, deepMonoImages)
+{
+    MemoryFileManager files;
+    const Utils::FileManagerRegistration registration(dir, files);
+
+    // values above 8 bit range, so any narrowing would show up
+    const auto paths = storeFrames(files, {
+        cv::Mat(4, 6, CV_16UC1, cv::Scalar(1000)),
+        cv::Mat(4, 6, CV_16UC1, cv::Scalar(65535)),
+        cv::Mat(4, 6, CV_16UC1, cv::Scalar(40000)),
+    });
+
+    const auto median = medianStacking(paths);
+    ASSERT_EQ(median.type(), CV_16UC1);
+    ASSERT_EQ(median.size(), cv::Size(6, 4));
+    EXPECT_EQ(cv::countNonZero(median != 40000), 0);
+}
+
+
+TEST(MedianStackingTest, deepColorImages)
+{
+    MemoryFileManager files;
+    const Utils::FileManagerRegistration registration(dir, files);
+
+    // pixels are ordered by brightness, channels are not mixed
+    const auto paths = storeFrames(files, {
+        cv::Mat(4, 6, CV_16UC3, cv::Scalar(1000, 2000, 3000)),
+        cv::Mat(4, 6, CV_16UC3, cv::Scalar(60000, 50000, 65535)),
+        cv::Mat(4, 6, CV_16UC3, cv::Scalar(30000, 20000, 10000)),
+    });
+
+    const auto median = medianStacking(paths);
+    ASSERT_EQ(median.type(), CV_16UC3);
+    ASSERT_EQ(median.size(), cv::Size(6, 4));
+    EXPECT_EQ(median.at<cv::Vec3w>(0, 0), cv::Vec3w(30000, 20000, 10000));
+    EXPECT_EQ(median.at<cv::Vec3w>(3, 5), cv::Vec3w(30000, 20000, 10000));
+}
+
+
+TEST(AverageStackTest, removedImagesDoNotContribute)
+{
+    AverageStack stack;
+
+    stack.add(cv::Mat(4, 6, CV_16UC3, cv::Scalar(1000, 2000, 3000)));
+    stack.add(cv::Mat(4, 6, CV_16UC3, cv::Scalar(65535, 65535, 65535)));
+    stack.add(cv::Mat(4, 6, CV_16UC3, cv::Scalar(3000, 4000, 5000)));
+    EXPECT_EQ(stack.count(), 3);
+
+    // bright image leaves the window
+    stack.remove(cv::Mat(4, 6, CV_16UC3, cv::Scalar(65535, 65535, 65535)));
+    EXPECT_EQ(stack.count(), 2);
+
+    const auto twoImages = stack.result();
+    ASSERT_EQ(twoImages.type(), CV_16UC3);
+    ASSERT_EQ(twoImages.size(), cv::Size(6, 4));
+    EXPECT_EQ(twoImages.at<cv::Vec3w>(0, 0), cv::Vec3w(2000, 3000, 4000));
+    EXPECT_EQ(twoImages.at<cv::Vec3w>(3, 5), cv::Vec3w(2000, 3000, 4000));
+
+    stack.remove(cv::Mat(4, 6, CV_16UC3, cv::Scalar(1000, 2000, 3000)));
+    stack.add(cv::Mat(4, 6, CV_16UC3, cv::Scalar(7000, 8000, 9000)));
+    EXPECT_EQ(stack.count(), 2);
+
+    const auto nextWindow = stack.result();
+    EXPECT_EQ(nextWindow.at<cv::Vec3w>(0, 0), cv::Vec3w(5000, 6000, 7000));
+}
+
+
+TEST(AverageStackTest, matchesAverageStacking)
+{
+    MemoryFileManager files;
+    const Utils::FileManagerRegistration registration(dir, files);
+
+    const std::vector<cv::Mat> frames = {
+        cv::Mat(4, 6, CV_8UC1, cv::Scalar(10)),
+        cv::Mat(4, 6, CV_8UC1, cv::Scalar(20)),
+        cv::Mat(4, 6, CV_8UC1, cv::Scalar(60)),
+    };
+    const auto paths = storeFrames(files, frames);
+
+    AverageStack stack;
+    for (const auto& frame: frames)
+        stack.add(frame);
+
+    EXPECT_EQ(cv::countNonZero(stack.result() != averageStacking(paths)), 0);
+    EXPECT_EQ(cv::countNonZero(stack.result() != 30), 0);
+}
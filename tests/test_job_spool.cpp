@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+import job_spool;
+
+using testing::ElementsAre;
+using testing::HasSubstr;
+
+
+namespace
+{
+    class JobSpoolTest: public testing::Test
+    {
+    protected:
+        const std::filesystem::path dir = std::filesystem::temp_directory_path() / "astro-stacker-spool-test";
+
+        void SetUp() override
+        {
+            std::filesystem::remove_all(dir);
+            std::filesystem::create_directories(dir);
+        }
+
+        void TearDown() override
+        {
+            std::filesystem::remove_all(dir);
+        }
+
+        void writeJob(const std::string& name, const std::string& content, std::chrono::seconds age)
+        {
+            const auto path = dir / (name + ".job");
+            std::ofstream(path) << content;
+            std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now() - age);
+        }
+
+        std::string readFile(const std::filesystem::path& path)
+        {
+            std::stringstream content;
+            content << std::ifstream(path).rdbuf();
+            return content.str();
+        }
+    };
+}
+
+
+TEST_F(JobSpoolTest, pendingJobsAreOrderedByArrival)
+{
+    const JobSpool spool(dir);
+
+    writeJob("second", "b.ser", std::chrono::seconds(10));
+    writeJob("first", "a.ser", std::chrono::seconds(20));
+    writeJob("third", "c.ser", std::chrono::seconds(5));
+    std::ofstream(dir / "incomplete.job.tmp") << "d.ser";
+
+    const auto jobs = spool.pending();
+
+    ASSERT_EQ(jobs.size(), 3);
+    EXPECT_EQ(jobs[0].name, "first");
+    EXPECT_EQ(jobs[1].name, "second");
+    EXPECT_EQ(jobs[2].name, "third");
+}
+
+
+TEST_F(JobSpoolTest, argumentsAreReadLikeCommandLine)
+{
+    const JobSpool spool(dir);
+
+    writeJob("job", "# comment\n--priority 2\n  \"my capture.ser\" --skip 10\n", std::chrono::seconds(0));
+
+    const auto jobs = spool.pending();
+
+    ASSERT_EQ(jobs.size(), 1);
+    EXPECT_THAT(jobs[0].args, ElementsAre("--priority", "2", "my capture.ser", "--skip", "10"));
+}
+
+
+TEST_F(JobSpoolTest, jobFileIsMovedWithItsState)
+{
+    const JobSpool spool(dir);
+
+    writeJob("job", "a.ser", std::chrono::seconds(0));
+
+    const auto running = spool.start(spool.pending().front());
+    EXPECT_EQ(running.file, dir / "running" / "job.job");
+    EXPECT_TRUE(std::filesystem::exists(running.file));
+    EXPECT_TRUE(spool.pending().empty());
+
+    const auto failed = spool.finish(running, false);
+    EXPECT_EQ(failed.file, dir / "failed" / "job.job");
+    EXPECT_TRUE(std::filesystem::exists(failed.file));
+    EXPECT_FALSE(std::filesystem::exists(running.file));
+}
+
+
+TEST_F(JobSpoolTest, statusIsWrittenAsJson)
+{
+    const JobSpool spool(dir);
+
+    writeJob("job", "a.ser", std::chrono::seconds(0));
+    const auto job = spool.pending().front();
+
+    spool.writeStatus(job, JobStatus{
+        .state = JobState::Failed,
+        .priority = 3,
+        .inputs = {"a.ser"},
+        .workingDir = "out/job",
+        .waitTime = 1.5,
+        .runTime = 2.25,
+        .error = "Could not \"read\" frame",
+    });
+
+    const auto status = readFile(dir / "status" / "job.json");
+
+    EXPECT_THAT(status, HasSubstr(R"("job": "job")"));
+    EXPECT_THAT(status, HasSubstr(R"("state": "failed")"));
+    EXPECT_THAT(status, HasSubstr(R"("priority": 3)"));
+    EXPECT_THAT(status, HasSubstr(R"("inputs": ["a.ser"])"));
+    EXPECT_THAT(status, HasSubstr(R"("wait_s": 1.500)"));
+    EXPECT_THAT(status, HasSubstr(R"("run_s": 2.250)"));
+    EXPECT_THAT(status, HasSubstr(R"("error": "Could not \"read\" frame")"));
+    EXPECT_FALSE(std::filesystem::exists(dir / "status" / "job.json.tmp"));
+}
@@ -0,0 +1,90 @@
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+import memory_file_manager;
+import utils;
+
+
+namespace
+{
+    const std::filesystem::path wd = "/non-existing-dir/wd";
+
+    bool equal(const cv::Mat& lhs, const cv::Mat& rhs)
+    {
+        return lhs.size() == rhs.size() && lhs.type() == rhs.type() && cv::norm(lhs, rhs, cv::NORM_INF) == 0;
+    }
+}
+
+
+TEST(MemoryFileManagerTest, writtenImageCanBeRead)
+{
+    MemoryFileManager fm;
+    cv::Mat image(10, 20, CV_8UC3, cv::Scalar(1, 2, 3));
+
+    fm.write(wd / "#1 images" / "1.png", image, {});
+    image.setTo(cv::Scalar(0, 0, 0));                   // manager keeps own copy
+
+    const auto read = fm.read(wd / "#1 images" / "1.png", cv::IMREAD_COLOR);
+    EXPECT_TRUE(equal(read, cv::Mat(10, 20, CV_8UC3, cv::Scalar(1, 2, 3))));
+}
+
+
+TEST(MemoryFileManagerTest, imageIsConvertedAccordingToReadFlags)
+{
+    MemoryFileManager fm;
+    const cv::Mat gray(10, 20, CV_8UC1, cv::Scalar(7));
+
+    fm.write(wd / "gray.png", gray, {});
+
+    EXPECT_EQ(fm.read(wd / "gray.png", cv::IMREAD_COLOR).channels(), 3);
+    EXPECT_EQ(fm.read(wd / "gray.png", cv::IMREAD_UNCHANGED).channels(), 1);
+}
+
+
+TEST(MemoryFileManagerTest, copiedImagesAreAvailableUnderBothPaths)
+{
+    MemoryFileManager fm;
+    const cv::Mat image(10, 20, CV_8UC3, cv::Scalar(1, 2, 3));
+
+    fm.write(wd / "#1 images" / "1.png", image, {});
+    fm.copy(wd / "#1 images" / "1.png", wd / "#2 best" / "1.png");
+
+    EXPECT_TRUE(equal(fm.read(wd / "#1 images" / "1.png", cv::IMREAD_COLOR), image));
+    EXPECT_TRUE(equal(fm.read(wd / "#2 best" / "1.png", cv::IMREAD_COLOR), image));
+}
+
+
+TEST(MemoryFileManagerTest, removedDirectoryReleasesItsImages)
+{
+    MemoryFileManager fm;
+    const cv::Mat image(10, 20, CV_8UC3, cv::Scalar(1, 2, 3));
+
+    fm.write(wd / "#1 images" / "1.png", image, {});
+    fm.write(wd / "#1 images" / "2.png", image, {});
+    fm.write(wd / "#2 best" / "1.png", image, {});
+
+    fm.remove(wd / "#1 images");
+
+    EXPECT_TRUE(fm.read(wd / "#1 images" / "1.png", cv::IMREAD_COLOR).empty());
+    EXPECT_TRUE(fm.read(wd / "#1 images" / "2.png", cv::IMREAD_COLOR).empty());
+    EXPECT_FALSE(fm.read(wd / "#2 best" / "1.png", cv::IMREAD_COLOR).empty());
+}
+
+
+TEST(MemoryFileManagerTest, consumedImageIsReleased)
+{
+    MemoryFileManager fm;
+    const cv::Mat image(10, 20, CV_8UC3, cv::Scalar(1, 2, 3));
+    const std::vector<std::filesystem::path> files = {wd / "#1 images" / "1.png"};
+
+    fm.write(files.front(), image, {});
+    fm.consumable(files);
+
+    Utils::fileConsumed(files.front());
+
+    EXPECT_TRUE(fm.read(files.front(), cv::IMREAD_COLOR).empty());
+}
@@ -0,0 +1,58 @@
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+
+import progress;
+
+
+namespace
+{
+    size_t doneFrames(const std::string& name)
+    {
+        for (const auto& step: Progress::activeSteps())
+            if (step->name() == name)
+                return step->done();
+
+        return 0;
+    }
+}
+
+
+TEST(ProgressTest, counterOfStepIsFoundByDirectory)
+{
+    const std::filesystem::path dir = "/wd/#2 best";
+    const Progress::StepScope step("best", 10, dir);
+
+    Progress::counter(dir).advance();
+    Progress::counter(dir / "debug" / "1.png").advance(2);
+    Progress::counter("/wd/#3 aligned").advance();          // not tracked
+
+    EXPECT_EQ(doneFrames("best"), 3);
+}
+
+
+TEST(ProgressTest, mostNestedStepWins)
+{
+    const Progress::StepScope outer("outer", 10, "/wd");
+    const Progress::StepScope inner("inner", 10, "/wd/#1 images");
+
+    Progress::counter("/wd/#1 images/1.png").advance();
+
+    EXPECT_EQ(doneFrames("outer"), 0);
+    EXPECT_EQ(doneFrames("inner"), 1);
+}
+
+
+TEST(ProgressTest, finishedStepIsNotReported)
+{
+    {
+        const Progress::StepScope step("temporary", 10, "/wd/#1 images");
+        EXPECT_EQ(Progress::activeSteps().size(), 1);
+    }
+
+    EXPECT_TRUE(Progress::activeSteps().empty());
+
+    // counter of finished step does nothing
+    EXPECT_NO_THROW(Progress::counter("/wd/#1 images").advance());
+}
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+import star_matcher;
+
+
+namespace
+{
+    cv::Mat starField(const std::vector<cv::Point2f>& stars)
+    {
+        cv::Mat field(400, 400, CV_8UC1, cv::Scalar(10));
+
+        for (size_t i = 0; i < stars.size(); i++)
+            cv::circle(field, stars[i], 2, cv::Scalar(255 - static_cast<double>(i) * 5), cv::FILLED, cv::LINE_AA);
+
+        cv::GaussianBlur(field, field, cv::Size(0, 0), 1.0);
+
+        return field;
+    }
+
+    // stars are scattered around nodes of a grid, so they never merge
+    std::vector<cv::Point2f> randomStars(size_t count)
+    {
+        cv::RNG rng(7);
+        std::vector<cv::Point2f> stars;
+
+        for (size_t i = 0; i < count; i++)
+            stars.emplace_back(60.f + (i % 5) * 70.f + rng.uniform(-25.f, 25.f), 60.f + (i / 5) * 70.f + rng.uniform(-25.f, 25.f));
+
+        return stars;
+    }
+}
+
+
+TEST(StarMatcherTest, starsAreDetected)
+{
+    const auto stars = randomStars(20);
+    const auto detected = detectStars(starField(stars));
+
+    EXPECT_EQ(detected.size(), stars.size());
+}
+
+
+TEST(StarMatcherTest, transformationOfRotatedFieldIsFound)
+{
+    const auto stars = randomStars(20);
+
+    // reference field rotated by 3 degrees around center and shifted
+    const cv::Mat rotation = cv::getRotationMatrix2D(cv::Point2f(200, 200), 3.0, 1.0);
+    std::vector<cv::Point2f> moved;
+    cv::transform(stars, moved, rotation);
+    for (auto& star: moved)
+        star += cv::Point2f(7, -4);
+
+    const auto match = matchStarFields(detectStarField(starField(stars)), detectStarField(starField(moved)));
+    ASSERT_TRUE(match.has_value());
+
+    // star moved with found transformation lands where it was moved
+    const cv::Mat& t = match->transformation;
+    const cv::Point2f& star = stars.front();
+    const cv::Point2f transformed(t.at<float>(0, 0) * star.x + t.at<float>(0, 1) * star.y + t.at<float>(0, 2),
+                                  t.at<float>(1, 0) * star.x + t.at<float>(1, 1) * star.y + t.at<float>(1, 2));
+
+    EXPECT_NEAR(transformed.x, moved.front().x, 0.5);
+    EXPECT_NEAR(transformed.y, moved.front().y, 0.5);
+}
+
+
+TEST(StarMatcherTest, emptyFieldDoesNotMatch)
+{
+    const auto reference = detectStarField(starField(randomStars(20)));
+    const auto empty = detectStarField(cv::Mat(400, 400, CV_8UC1, cv::Scalar(10)));
+
+    EXPECT_FALSE(matchStarFields(reference, empty).has_value());
+}
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <ranges>
+#include <stdexcept>
+#include <vector>
+
+import utils;
+
+
+TEST(TaskPoolTest, allItemsAreVisited)
+{
+    std::vector<std::atomic<int>> visits(1000);
+
+    Utils::forEach(std::views::iota(0, 1000), [&](const size_t i)
+    {
+        visits[i]++;
+    });
+
+    for (const auto& v: visits)
+        EXPECT_EQ(v.load(), 1);
+}
+
+
+TEST(TaskPoolTest, nestedTasks)
+{
+    std::vector<std::atomic<int>> visits(100);
+
+    Utils::forEach(std::views::iota(0, 100), [&](const size_t i)
+    {
+        Utils::forEach(std::views::iota(0, 10), [&](const size_t)
+        {
+            visits[i]++;
+        });
+    });
+
+    for (const auto& v: visits)
+        EXPECT_EQ(v.load(), 10);
+}
+
+
+TEST(TaskPoolTest, exceptionIsPropagated)
+{
+    auto loop = []
+    {
+        Utils::forEach(std::views::iota(0, 100), [](const size_t i)
+        {
+            if (i == 50)
+                throw std::runtime_error("task failed");
+        });
+    };
+
+    EXPECT_THROW(loop(), std::runtime_error);
+}
+
+
+TEST(TaskPoolTest, singleThreadedPool)
+{
+    Utils::TaskPool pool(1);
+    Utils::TaskGroup group(pool);
+    std::atomic<int> executed = 0;
+
+    for (int i = 0; i < 100; i++)
+        group.run([&]
+        {
+            executed++;
+        });
+
+    group.wait();
+
+    EXPECT_EQ(executed.load(), 100);
+}
+
+
+TEST(TaskPoolTest, waitingThreadRunsOwnTasksOnly)
+{
+    // no workers: tasks are executed only by threads waiting for them
+    Utils::TaskPool pool(1);
+    Utils::TaskGroup other(pool);
+    std::atomic<bool> otherExecuted = false;
+
+    other.run([&]
+    {
+        otherExecuted = true;
+    });
+
+    Utils::TaskGroup group(pool);
+    std::atomic<int> executed = 0;
+
+    for (int i = 0; i < 10; i++)
+        group.run([&]
+        {
+            executed++;
+        });
+
+    group.wait();
+
+    EXPECT_EQ(executed.load(), 10);
+    EXPECT_FALSE(otherExecuted.load());
+
+    other.wait();
+    EXPECT_TRUE(otherExecuted.load());
+}
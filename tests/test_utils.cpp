@@ -2,7 +2,13 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
 
+import memory_file_manager;
 import utils;
 
 
@@ -53,3 +59,157 @@ TEST_P(SplitTest, split)
 
     EXPECT_EQ(results, expectedResult);
 }
+
+
+TEST(NaturalLessTest, numbersAreComparedByValue)
+{
+    std::vector<std::string> names = {"moon.mp4-10.png", "moon.mp4-9.png", "moon.mp4-100.png", "moon.mp4-0.png", "moon.mp4-11.png"};
+    std::ranges::sort(names, Utils::naturalLess);
+
+    EXPECT_EQ(names, (std::vector<std::string>{"moon.mp4-0.png", "moon.mp4-9.png", "moon.mp4-10.png", "moon.mp4-11.png", "moon.mp4-100.png"}));
+}
+
+
+TEST(NaturalLessTest, leadingZeros)
+{
+    EXPECT_TRUE(Utils::naturalLess("img-007", "img-10"));
+    EXPECT_FALSE(Utils::naturalLess("img-10", "img-007"));
+    EXPECT_TRUE(Utils::naturalLess("img-7", "img-7a"));
+}
+
+
+TEST(CodecTest, png)
+{
+    const auto codec = Utils::readCodec("png:1:rle");
+    ASSERT_TRUE(codec);
+    EXPECT_EQ(codec->extension, ".png");
+    EXPECT_EQ(codec->parameters, (std::vector<int>{cv::IMWRITE_PNG_COMPRESSION, 1, cv::IMWRITE_PNG_STRATEGY, cv::IMWRITE_PNG_STRATEGY_RLE}));
+}
+
+
+TEST(CodecTest, uncompressedTiff)
+{
+    const auto codec = Utils::readCodec("tiff");
+    ASSERT_TRUE(codec);
+    EXPECT_EQ(codec->extension, ".tiff");
+    EXPECT_EQ(codec->parameters, (std::vector<int>{cv::IMWRITE_TIFF_COMPRESSION, 1}));
+}
+
+
+TEST(CodecTest, invalid)
+{
+    EXPECT_FALSE(Utils::readCodec("png:10"));
+    EXPECT_FALSE(Utils::readCodec("png:abc"));
+    EXPECT_FALSE(Utils::readCodec("png:1x"));
+    EXPECT_FALSE(Utils::readCodec("png:"));
+    EXPECT_FALSE(Utils::readCodec("png:1:unknown"));
+    EXPECT_FALSE(Utils::readCodec("tiff:jpeg"));
+    EXPECT_FALSE(Utils::readCodec("jpeg"));
+}
+
+
+TEST(CodecTest, bmpScalesDeepImages)
+{
+    const auto codec = Utils::readCodec("bmp");
+    ASSERT_TRUE(codec);
+    EXPECT_TRUE(codec->eightBitOnly);
+
+    const std::filesystem::path dir = "/non-existing-dir/bmp";
+    MemoryFileManager files;
+    const Utils::FileManagerRegistration registration(dir, files);
+
+    const auto previousPolicy = Utils::codecPolicy(Utils::ImageRole::Intermediate);
+    Utils::setCodecPolicy(Utils::ImageRole::Intermediate, *codec);
+
+    const auto path = Utils::writeImage(dir / "1.png", cv::Mat(10, 20, CV_16UC1, cv::Scalar(257 * 100)));
+    Utils::setCodecPolicy(Utils::ImageRole::Intermediate, previousPolicy);
+
+    EXPECT_EQ(path.extension(), ".bmp");
+
+    // values are scaled, not saturated
+    const auto image = Utils::readImage(path);
+    EXPECT_EQ(image.type(), CV_8UC1);
+    EXPECT_EQ(image.at<uchar>(0, 0), 100);
+}
+
+
+TEST(MonochromeTest, imagesWithEqualChannelsAreMono)
+{
+    EXPECT_TRUE(Utils::isMonochrome(cv::Mat(10, 20, CV_8UC1, cv::Scalar(5))));
+    EXPECT_TRUE(Utils::isMonochrome(cv::Mat(10, 20, CV_8UC3, cv::Scalar(5, 5, 5))));
+
+    cv::Mat color(10, 20, CV_8UC3, cv::Scalar(5, 5, 5));
+    color.at<cv::Vec3b>(9, 19) = cv::Vec3b(5, 6, 5);
+    EXPECT_FALSE(Utils::isMonochrome(color));
+}
+
+
+TEST(MonochromeTest, monoImageIsNotConvertedToGray)
+{
+    const cv::Mat mono(10, 20, CV_8UC1, cv::Scalar(5));
+    cv::Mat buffer;
+
+    const cv::Mat& gray = Utils::toGray(mono, buffer);
+    EXPECT_EQ(gray.data, mono.data);
+    EXPECT_TRUE(buffer.empty());
+}
+
+
+TEST(DepthTest, deepImagesAreSupported)
+{
+    EXPECT_TRUE(Utils::isMonochrome(cv::Mat(10, 20, CV_16UC3, cv::Scalar(1000, 1000, 1000))));
+    EXPECT_FALSE(Utils::isMonochrome(cv::Mat(10, 20, CV_16UC3, cv::Scalar(1000, 1001, 1000))));
+
+    const cv::Mat deep(10, 20, CV_16UC1, cv::Scalar(65535));
+    cv::Mat buffer;
+
+    const cv::Mat& image8 = Utils::to8Bit(deep, buffer);
+    EXPECT_EQ(image8.type(), CV_8UC1);
+    EXPECT_EQ(image8.at<uchar>(0, 0), 255);
+}
+
+
+TEST(EscapeJsonTest, specialCharactersAreEscaped)
+{
+    EXPECT_EQ(Utils::escapeJson("plain name.jpg"), "plain name.jpg");
+    EXPECT_EQ(Utils::escapeJson(R"(C:\dir\"img".jpg)"), R"(C:\\dir\\\"img\".jpg)");
+    EXPECT_EQ(Utils::escapeJson("a\nb\rc\td"), R"(a\nb\rc\td)");
+    EXPECT_EQ(Utils::escapeJson(std::string("\x01\x1f", 2)), R"(\u0001\u001f)");
+}
+
+
+TEST(LinkFilesTest, sameNamedFilesFromSubdirectoriesAreKept)
+{
+    const std::filesystem::path dir = "/non-existing-dir/link";
+    MemoryFileManager files;
+    const Utils::FileManagerRegistration registration(dir, files);
+
+    // recursive listing of input directory
+    const std::vector<std::filesystem::path> inputs = {dir / "input/night1/0001.png", dir / "input/night2/0001.png", dir / "input/night2/0002.png"};
+    for (size_t i = 0; i < inputs.size(); i++)
+        files.add(inputs[i], cv::Mat(4, 6, CV_8UC1, cv::Scalar(static_cast<double>(i + 1))));
+
+    const auto linked = Utils::linkFiles(inputs, dir / "output");
+    ASSERT_EQ(linked.size(), inputs.size());
+
+    EXPECT_EQ(linked[0], dir / "output/0001.png");
+    EXPECT_EQ(linked[2], dir / "output/0002.png");
+    EXPECT_NE(linked[1], linked[0]);
+    EXPECT_EQ(linked[1].parent_path(), dir / "output");
+
+    for (size_t i = 0; i < linked.size(); i++)
+        EXPECT_EQ(Utils::readImage(linked[i]).at<uchar>(0, 0), i + 1);
+}
+
+
+TEST(UniqueFileNamesTest, namesDifferingInExtensionOnlyAreMadeUnique)
+{
+    // image format of outputs may be different, so extension does not make names unique
+    const std::vector<std::filesystem::path> inputs = {"a/1.png", "b/1.tif", "c/1-2.png"};
+
+    const auto names = Utils::uniqueFileNames(inputs);
+    ASSERT_EQ(names.size(), inputs.size());
+    EXPECT_EQ(names[0], "1.png");
+    EXPECT_EQ(names[1], "1-2.tif");
+    EXPECT_EQ(names[2], "1-2-3.png");
+}
@@ -0,0 +1,38 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <utility>
+#include <vector>
+
+import window_stacker;
+
+using testing::ElementsAre;
+using Range = std::pair<size_t, size_t>;
+
+
+TEST(WindowRangesTest, overlappingWindows)
+{
+    // last window ends exactly at the last frame
+    EXPECT_THAT(windowRanges(10, 4, 3), ElementsAre(Range(0, 4), Range(3, 7), Range(6, 10)));
+}
+
+
+TEST(WindowRangesTest, adjacentWindows)
+{
+    // frames 8 and 9 would make an incomplete window, so they are not stacked
+    EXPECT_THAT(windowRanges(10, 4, 4), ElementsAre(Range(0, 4), Range(4, 8)));
+}
+
+
+TEST(WindowRangesTest, framesBetweenWindowsAreSkipped)
+{
+    EXPECT_THAT(windowRanges(8, 2, 3), ElementsAre(Range(0, 2), Range(3, 5), Range(6, 8)));
+}
+
+
+TEST(WindowRangesTest, windowLongerThanInput)
+{
+    // single window takes all frames even if it is not full
+    EXPECT_THAT(windowRanges(3, 5, 1), ElementsAre(Range(0, 3)));
+    EXPECT_THAT(windowRanges(5, 5, 1), ElementsAre(Range(0, 5)));
+}
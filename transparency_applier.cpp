@@ -3,6 +3,7 @@ module;
 
 #include <filesystem>
 #include <span>
+#include <stdexcept>
 #include <vector>
 
 #include <opencv2/opencv.hpp>
@@ -12,22 +13,49 @@ export module transparency_applier;
 import utils;
 
 
-export std::vector<std::filesystem::path> applyTransparency(const std::filesystem::path& dir, const std::span<const std::filesystem::path> images, int threshold)
+namespace
 {
-    const std::vector<std::filesystem::path> transparent = Utils::processImages(images, dir, [&threshold](const cv::Mat& image)
+    template<typename T>
+    void clearAlpha(cv::Mat& rgbaImage, T threshold)
     {
-        cv::Mat rgbaImage;
-        cv::cvtColor(image, rgbaImage, cv::COLOR_BGR2BGRA);
-
         for (int y = 0; y < rgbaImage.rows; ++y)
+        {
+            auto* row = rgbaImage.ptr<cv::Vec<T, 4>>(y);
+
             for (int x = 0; x < rgbaImage.cols; ++x)
             {
-                cv::Vec4b& pixel = rgbaImage.at<cv::Vec4b>(y, x);
+                auto& pixel = row[x];
                 if (pixel[0] <= threshold && pixel[1] <= threshold && pixel[2] <= threshold)
                     pixel[3] = 0;
             }
+        }
+    }
+}
+
+
+// Make pixels darker than or equal to threshold (in every channel) fully transparent.
+// Threshold is given in 8 bit scale, for 16 bit images it is scaled accordingly.
+export cv::Mat makeTransparent(const cv::Mat& image, int threshold)
+{
+    cv::Mat rgbaImage;
+    cv::cvtColor(image, rgbaImage, image.channels() == 1? cv::COLOR_GRAY2BGRA: cv::COLOR_BGR2BGRA);
 
-        return rgbaImage;
+    if (rgbaImage.depth() == CV_8U)
+        clearAlpha(rgbaImage, cv::saturate_cast<uchar>(threshold));
+    else if (rgbaImage.depth() == CV_16U)
+        clearAlpha(rgbaImage, cv::saturate_cast<ushort>(threshold * 257));
+    else
+        throw std::runtime_error("Unsupported depth of image for transparency: " + cv::depthToString(rgbaImage.depth()));
+
+    return rgbaImage;
+}
+
+
+export std::vector<std::filesystem::path> applyTransparency(const std::filesystem::path& dir, const std::span<const std::filesystem::path> images, int threshold)
+{
+    const std::vector<std::filesystem::path> transparent = Utils::processImages(images, dir, Utils::ImageRole::Output, [&threshold](const cv::Mat& image)
+    {
+        return makeTransparent(image, threshold);
     });
 
     return transparent;
@@ -1,18 +1,31 @@
 
 module;
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
 #include <concepts>
 #include <filesystem>
 #include <format>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <ranges>
+#include <semaphore>
+#include <set>
+#include <shared_mutex>
 #include <span>
 #include <string>
 #include <boost/algorithm/string.hpp>
 #include <opencv2/opencv.hpp>
-#include <spdlog/spdlog.h>
 
 
 export module utils;
+export import json;
+export import task_pool;
+import ifile_manager;
+import progress;
 
 namespace Utils
 {
@@ -31,7 +44,7 @@ namespace Utils
             std::chrono::time_point<std::chrono::high_resolution_clock> start_time;
     };
 
-    template<typename Func, typename... Args>
+    export template<typename Func, typename... Args>
     auto measureTime(Func func, Args&&... args)
     {
         Timer timer;
@@ -41,100 +54,530 @@ namespace Utils
     }
 
 
-    export template <typename Func, typename... Args>
-    auto measureTimeWithMessage(std::string_view startMessage, Func func, Args&&... args)
-    {
-        spdlog::info(startMessage);
-        auto [time, result] = measureTime(func, std::forward<Args>(args)...);
-        spdlog::info("Execution time: {}ms", time);
-        return result;
-    }
+    // Operation applied to each frame while it is acquired. May be stateful (like object tracking),
+    // so each continous run of frames gets its own instance from factory.
+    export using FrameTransform = std::function<cv::Mat(const cv::Mat &)>;
+    export using FrameTransformFactory = std::function<FrameTransform()>;
 
 
     export template<typename T, typename C>
     void forEach(T items, C&& c)
     {
         const auto size = items.size();
-        std::exception_ptr exception = nullptr;
+        TaskGroup group;
 
-        #pragma omp parallel for
         for(size_t i = 0; i < size; i++)
-        {
-            try
+            group.run([&c, i]
             {
                 c(static_cast<size_t>(i));
+            });
+
+        group.wait();
+    }
+
+    // number of threads available for parallel work
+    export size_t threads()
+    {
+        return TaskPool::global().threads();
+    }
+
+
+    // Storage used when no file manager is set. Keeps all files.
+    struct DiskStorage: IFileManager
+    {
+        void remove(const std::filesystem::path &) override {}
+        void consumable(std::span<const std::filesystem::path>) override {}
+    };
+
+    std::atomic<IFileManager*>& activeFileManager()
+    {
+        static DiskStorage diskStorage;
+        static std::atomic<IFileManager*> fileManager = &diskStorage;
+        return fileManager;
+    }
+
+    // All images and working directories are accessed through this file manager.
+    // Needs to be set before any file is accessed and has to outlive all operations.
+    export void setFileManager(IFileManager& fileManager)
+    {
+        activeFileManager() = &fileManager;
+    }
+
+    export IFileManager& fileManager()
+    {
+        return *activeFileManager().load();
+    }
+
+    struct FileManagersRegistry
+    {
+        std::shared_mutex mutex;
+        std::map<std::filesystem::path, IFileManager*> managers;
+        std::atomic<size_t> size = 0;
+    };
+
+    FileManagersRegistry& fileManagersRegistry()
+    {
+        static FileManagersRegistry registry;
+        return registry;
+    }
+
+    // File manager used for given directory (and its subdirectories) instead of the active one.
+    // Lets embedders keep their own working directories in memory, without affecting other users of the process.
+    export void registerFileManager(const std::filesystem::path& dir, IFileManager& fileManager)
+    {
+        auto& r = fileManagersRegistry();
+        std::unique_lock lock(r.mutex);
+        r.managers[dir] = &fileManager;
+        r.size = r.managers.size();
+    }
+
+    export void unregisterFileManager(const std::filesystem::path& dir)
+    {
+        auto& r = fileManagersRegistry();
+        std::unique_lock lock(r.mutex);
+        r.managers.erase(dir);
+        r.size = r.managers.size();
+    }
+
+    // File manager responsible for given path: the one registered for the most nested directory containing it, or the active one
+    export IFileManager& fileManager(const std::filesystem::path& path)
+    {
+        auto& r = fileManagersRegistry();
+
+        if (r.size == 0)
+            return fileManager();
+
+        std::shared_lock lock(r.mutex);
+        for (auto dir = path; dir.empty() == false; dir = dir.parent_path())
+        {
+            if (const auto it = r.managers.find(dir); it != r.managers.end())
+                return *it->second;
+
+            if (dir == dir.parent_path())
+                break;
+        }
+
+        return fileManager();
+    }
+
+    export class FileManagerRegistration
+    {
+    public:
+        FileManagerRegistration(const std::filesystem::path& dir, IFileManager& fileManager)
+            : m_dir(dir)
+        {
+            registerFileManager(m_dir, fileManager);
+        }
+
+        FileManagerRegistration(const FileManagerRegistration &) = delete;
+        FileManagerRegistration& operator=(const FileManagerRegistration &) = delete;
+
+        ~FileManagerRegistration()
+        {
+            unregisterFileManager(m_dir);
+        }
+
+    private:
+        const std::filesystem::path m_dir;
+    };
+
+    // Mono images are read as single channel ones, color images as BGR. 16 bit images keep their depth.
+    export cv::Mat readImage(const std::filesystem::path& path, int flags = cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH)
+    {
+        return fileManager(path).read(path, flags);
+    }
+
+
+    // Brightest possible value of image's samples (255 for 8 bit images, 65535 for 16 bit ones)
+    export double maxValue(const cv::Mat& image)
+    {
+        return image.depth() == CV_16U? 65535.0: 255.0;
+    }
+
+    // 8 bit version of image for algorithms which support 8 bit images only. 8 bit image is returned as is.
+    export const cv::Mat& to8Bit(const cv::Mat& image, cv::Mat& buffer)
+    {
+        if (image.depth() == CV_8U)
+            return image;
+
+        image.convertTo(buffer, CV_MAKETYPE(CV_8U, image.channels()), 255.0 / maxValue(image));
+        return buffer;
+    }
+
+
+    export enum class ImageRole
+    {
+        Intermediate,       // image consumed by next step
+        Output,             // final result (stacks and later)
+    };
+
+    export struct CodecPolicy
+    {
+        std::optional<std::string> extension;       // file format. Empty means: keep original file extension (png for video frames)
+        std::vector<int> parameters;                // cv::imwrite parameters
+        bool eightBitOnly = false;                  // format cannot store 16 bit images, they are scaled down when written
+    };
+
+    std::map<ImageRole, CodecPolicy>& codecPolicies()
+    {
+        static std::map<ImageRole, CodecPolicy> policies = {
+            {ImageRole::Intermediate, {}},
+            {ImageRole::Output, {}},
+        };
+        return policies;
+    }
+
+    // Needs to be called before any image is written to take effect
+    export void setCodecPolicy(ImageRole role, const CodecPolicy& policy)
+    {
+        codecPolicies()[role] = policy;
+    }
+
+    export const CodecPolicy& codecPolicy(ImageRole role)
+    {
+        return codecPolicies().at(role);
+    }
+
+    // Write image with codec policy for given role. Path's extension may be changed by policy, final path is returned.
+    export std::filesystem::path writeImage(const std::filesystem::path& path, const cv::Mat& image, ImageRole role = ImageRole::Intermediate)
+    {
+        const auto& policy = codecPolicy(role);
+
+        std::filesystem::path outputPath = path;
+        if (policy.extension)
+            outputPath.replace_extension(*policy.extension);
+
+        // encoder would saturate 16 bit values instead of scaling them
+        if (policy.eightBitOnly && image.depth() != CV_8U)
+        {
+            cv::Mat buffer;
+            fileManager(outputPath).write(outputPath, to8Bit(image, buffer), policy.parameters);
+        }
+        else
+            fileManager(outputPath).write(outputPath, image, policy.parameters);
+
+        return outputPath;
+    }
+
+    // Read codec definition. Supported formats:
+    //  png[:level[:strategy]] - level: 0 (fastest) - 9 (smallest), strategy: default, filtered, huffman, rle, fixed
+    //  tiff[:compression]     - compression: none (default), lzw, deflate
+    //  bmp                    - uncompressed, 8 bit only
+    export std::optional<CodecPolicy> readCodec(std::string_view codecValue)
+    {
+        std::vector<std::string> split;
+        std::string input(codecValue);
+        boost::split(split, input, boost::is_any_of(":"));
+
+        const auto& format = split.front();
+
+        if (format == "png" && split.size() <= 3)
+        {
+            CodecPolicy policy{.extension = ".png"};
+
+            if (split.size() > 1)
+            {
+                const auto& levelValue = split[1];
+                int level = -1;
+                const auto [end, error] = std::from_chars(levelValue.data(), levelValue.data() + levelValue.size(), level);
+
+                if (error != std::errc() || end != levelValue.data() + levelValue.size() || level < 0 || level > 9)
+                    return {};
+
+                policy.parameters.insert(policy.parameters.end(), {cv::IMWRITE_PNG_COMPRESSION, level});
             }
-            catch (...)
+
+            if (split.size() > 2)
             {
-                exception = std::current_exception();
-    #ifdef MSVC
-                break;
-    #else
-                #pragma omp cancel for
-    #endif
+                const std::map<std::string, int> strategies = {
+                    {"default", cv::IMWRITE_PNG_STRATEGY_DEFAULT},
+                    {"filtered", cv::IMWRITE_PNG_STRATEGY_FILTERED},
+                    {"huffman", cv::IMWRITE_PNG_STRATEGY_HUFFMAN_ONLY},
+                    {"rle", cv::IMWRITE_PNG_STRATEGY_RLE},
+                    {"fixed", cv::IMWRITE_PNG_STRATEGY_FIXED},
+                };
+
+                const auto it = strategies.find(split[2]);
+                if (it == strategies.end())
+                    return {};
+
+                policy.parameters.insert(policy.parameters.end(), {cv::IMWRITE_PNG_STRATEGY, it->second});
             }
+
+            return policy;
         }
+        else if (format == "tiff" && split.size() <= 2)
+        {
+            // values as defined by libtiff
+            const std::map<std::string, int> compressions = {
+                {"none", 1},
+                {"lzw", 5},
+                {"deflate", 8},
+            };
+
+            const auto it = compressions.find(split.size() > 1? split[1]: "none");
+            if (it == compressions.end())
+                return {};
+
+            return CodecPolicy{.extension = ".tiff", .parameters = {cv::IMWRITE_TIFF_COMPRESSION, it->second}};
+        }
+        else if (format == "bmp" && split.size() == 1)
+            return CodecPolicy{.extension = ".bmp", .eightBitOnly = true};
+        else
+            return {};
+    }
+
+
+    // Registry of files which are not needed anymore once they were read (intermediate results of previous step).
+    // Readers report consumed files, owner of the file decides what to do with it.
+    class ConsumableFiles
+    {
+    public:
+        using Release = std::function<void(const std::filesystem::path &)>;
+
+        static ConsumableFiles& instance()
+        {
+            static ConsumableFiles files;
+            return files;
+        }
+
+        void add(std::span<const std::filesystem::path> files, const Release& release)
+        {
+            std::lock_guard lock(m_mutex);
+
+            for (const auto& file: files)
+                m_files.emplace(file, release);
+        }
+
+        void consumed(const std::filesystem::path& file)
+        {
+            std::unique_lock lock(m_mutex);
+
+            const auto it = m_files.find(file);
+            if (it == m_files.end())
+                return;
+
+            const auto release = it->second;
+            m_files.erase(it);
+            lock.unlock();
+
+            release(file);
+        }
+
+        void forget(const std::filesystem::path& dir)
+        {
+            std::lock_guard lock(m_mutex);
+
+            auto isInDir = [&dir](const std::filesystem::path& file)
+            {
+                return std::mismatch(dir.begin(), dir.end(), file.begin(), file.end()).first == dir.end();
+            };
+
+            // entries from one directory are next to each other
+            auto it = m_files.lower_bound(dir);
+            while (it != m_files.end() && isInDir(it->first))
+                it = m_files.erase(it);
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::map<std::filesystem::path, Release> m_files;
+    };
+
+    // Files to be released (with 'release' callback) as soon as they are consumed
+    export void addConsumableFiles(std::span<const std::filesystem::path> files, const std::function<void(const std::filesystem::path &)>& release)
+    {
+        ConsumableFiles::instance().add(files, release);
+    }
+
+    // Call after file was read for the last time
+    export void fileConsumed(const std::filesystem::path& file)
+    {
+        ConsumableFiles::instance().consumed(file);
+    }
+
+    // Drop all files from directory (recursively) from consumable files
+    export void forgetConsumableFiles(const std::filesystem::path& dir)
+    {
+        ConsumableFiles::instance().forget(dir);
+    }
+
+
+    export struct PipelineOptions
+    {
+        size_t decodeThreads = 2;
+        size_t encodeThreads = 2;
+        size_t queueDepth = 0;              // max number of frames being processed at once. 0 means twice the number of threads
+    };
+
+    PipelineOptions& pipelineOptionsStorage()
+    {
+        static PipelineOptions options;
+        return options;
+    }
+
+    // Needs to be called before first call to processImages() to take effect
+    export void setPipelineOptions(const PipelineOptions& options)
+    {
+        pipelineOptionsStorage() = options;
+    }
+
+    export const PipelineOptions& pipelineOptions()
+    {
+        return pipelineOptionsStorage();
+    }
 
-        if (exception)
-            std::rethrow_exception(exception);
+    // Pools for I/O bound work. Their threads are not counted as compute threads.
+    // TaskPool runs threads - 1 workers (waiting thread is the extra one), but nobody waits on these pools directly.
+    export TaskPool& decodePool()
+    {
+        static TaskPool pool(pipelineOptions().decodeThreads + 1);
+        return pool;
+    }
+
+    export TaskPool& encodePool()
+    {
+        static TaskPool pool(pipelineOptions().encodeThreads + 1);
+        return pool;
+    }
+
+
+    // Operation on image. It may also take path of the image (to identify frame)
+    export template<typename T>
+    concept ImageOperation = std::invocable<T, const cv::Mat &> || std::invocable<T, const cv::Mat &, const std::filesystem::path &>;
+
+    template<typename T>
+    decltype(auto) invokeOperation(T& op, const cv::Mat& image, const std::filesystem::path& path)
+    {
+        if constexpr (std::invocable<T &, const cv::Mat &, const std::filesystem::path &>)
+            return op(image, path);
+        else
+            return op(image);
     }
 
 
+    // Images are read, processed and written by separate pools, so compute threads do not wait for disk or for compression.
+    // Number of frames in flight is limited by PipelineOptions::queueDepth.
     export template<typename T, std::size_t N>
-    requires std::invocable<T, const cv::Mat &> && (N > 0)
-    std::vector<std::filesystem::path> processImages(std::span<const std::filesystem::path> images, const std::array<std::filesystem::path, N>& dirs, T&& op)
+    requires ImageOperation<T> && (N > 0)
+    std::vector<std::filesystem::path> processImages(std::span<const std::filesystem::path> images, const std::array<std::filesystem::path, N>& dirs, ImageRole role, T&& op)
     {
         const auto imagesCount = images.size();
         std::vector<std::filesystem::path> resultPaths(imagesCount);
 
-        forEach(images, [&](const size_t i)
-        {
-            const auto imagePath = images[i];
-            const auto imageFilename = imagePath.filename().string();
-            const cv::Mat image = cv::imread(imagePath.string());
+        const auto queueDepth = pipelineOptions().queueDepth > 0? pipelineOptions().queueDepth: 2 * threads();
+        std::counting_semaphore<> slots(static_cast<std::ptrdiff_t>(queueDepth));
+        TaskGroup group;
+
+        const auto progress = Progress::counter(dirs.front());
 
+        auto compute = [&op](const cv::Mat& image, const std::filesystem::path& path)
+        {
             std::array<cv::Mat, N>  results;
             if constexpr (N == 1)
-                results[0] = op(image);
+                results[0] = invokeOperation(op, image, path);
             else
-                results = op(image);
+                results = invokeOperation(op, image, path);
+
+            return results;
+        };
+
+        auto encode = [&](const size_t i, const std::array<cv::Mat, N>& results)
+        {
+            const auto imageFilename = images[i].filename().string();
 
             std::optional<std::filesystem::path> firstPath;
             for (const auto [result, dir]: std::views::zip(results, dirs))
             {
-                const auto path = dir / imageFilename;
-                cv::imwrite(path.string(), result);
+                const auto path = writeImage(dir / imageFilename, result, role);
 
                 if (!firstPath)
                     firstPath = path;
             }
 
             resultPaths[i] = firstPath.value();
-        });
+            slots.release();
+            progress.advance();
+        };
+
+        // wait for free slot, help with own computations meanwhile
+        auto acquireSlot = [&]
+        {
+            while (group.cancelled() == false)
+            {
+                if (slots.try_acquire())
+                    return true;
+
+                if (group.runPending() == false && slots.try_acquire_for(std::chrono::milliseconds(1)))
+                    return true;
+            }
+
+            return false;
+        };
+
+        // decode tasks are submitted in order, so input is read sequentially
+        for (size_t i = 0; i < imagesCount; i++)
+        {
+            if (acquireSlot() == false)
+                break;
+
+            group.run(decodePool(), [&, i]
+            {
+                const cv::Mat image = readImage(images[i]);
+                fileConsumed(images[i]);
+
+                group.run([&, i, image]
+                {
+                    const auto results = compute(image, images[i]);
+
+                    group.run(encodePool(), [&, i, results]
+                    {
+                        encode(i, results);
+                    });
+                });
+            });
+        }
+
+        group.wait();
 
         return resultPaths;
     }
 
     export template<typename T, std::size_t N>
-    requires std::invocable<T, const cv::Mat &> && (N > 0)
+    requires ImageOperation<T> && (N > 0)
+    std::vector<std::filesystem::path> processImages(std::span<const std::filesystem::path> images, const std::array<std::filesystem::path, N>& dirs, T&& op)
+    {
+        return processImages(images, dirs, ImageRole::Intermediate, op);
+    }
+
+    // Layout of steps with debug outputs: main output goes to the first of 'dirs' next to debug ones,
+    // or straight to their parent (step's directory) when there is no debug output. Returns main output's directory.
+    export template<std::size_t N>
+    requires (N > 0)
+    std::filesystem::path prepareOutputDirs(const std::array<std::filesystem::path, N>& dirs, bool debug)
+    {
+        if (debug == false)
+            return dirs.front().parent_path();
+
+        for (const auto& dir: dirs)
+            fileManager(dir).create(dir);
+
+        return dirs.front();
+    }
+
+    export template<typename T, std::size_t N>
+    requires ImageOperation<T> && (N > 0)
     std::vector<std::filesystem::path> processImages(std::span<const std::filesystem::path> images, const std::array<std::filesystem::path, N>& dirs, bool debug, T&& op)
     {
+        const auto outputDir = prepareOutputDirs(dirs, debug);
 
         if (debug)
-        {
-            for (const auto& dir: dirs)
-                std::filesystem::create_directory(dir);
-
-            return processImages(images, std::array{dirs}, op);
-        }
+            return processImages(images, dirs, op);
         else
         {
-            const auto firstDir = dirs.front();
-            const auto parentDir = firstDir.parent_path();
-
-            return processImages(images, std::array{parentDir}, [op](const auto& input)
+            return processImages(images, std::array{outputDir}, [op](const cv::Mat& input, const std::filesystem::path& path)
             {
-                const auto result = op(input);
+                const auto result = invokeOperation(op, input, path);
                 return result.front();
             });
         }
@@ -142,16 +585,152 @@ namespace Utils
 
 
     export template<typename T>
-    requires std::invocable<T, const cv::Mat &>
+    requires ImageOperation<T>
     std::vector<std::filesystem::path> processImages(std::span<const std::filesystem::path> images, const std::filesystem::path& dir, T&& op)
     {
         return processImages(images, std::array{dir}, op);
     }
 
 
+    export template<typename T>
+    requires ImageOperation<T>
+    std::vector<std::filesystem::path> processImages(std::span<const std::filesystem::path> images, const std::filesystem::path& dir, ImageRole role, T&& op)
+    {
+        return processImages(images, std::array{dir}, role, op);
+    }
+
+
+    // Per-thread reusable memory for temporary images, identified by name (string literal).
+    // Memory grows to the biggest requested image and is reused for smaller ones, so processing frames
+    // of a stable size does not allocate. Returned image is valid until the next call with the same name
+    // in the same thread - it must not be returned from operations or shared with other threads.
+    // Threads waiting for a group run its pending tasks (see TaskGroup::wait, Utils::forEach), which may use
+    // buffers of the same name, so a buffer must not be held across a wait for nested tasks.
+    export cv::Mat& threadBuffer(std::string_view name, const cv::Size& size, int type)
+    {
+        struct Buffer
+        {
+            cv::Mat storage;
+            cv::Mat view;
+        };
+
+        thread_local std::map<std::string_view, Buffer> buffers;
+
+        auto& buffer = buffers[name];
+
+        if (size.empty())
+        {
+            buffer.view.release();
+            return buffer.view;
+        }
+
+        const size_t requiredBytes = static_cast<size_t>(size.area()) * CV_ELEM_SIZE(type);
+        const size_t availableBytes = buffer.storage.empty()? 0: buffer.storage.total();
+
+        if (requiredBytes > availableBytes)
+            buffer.storage.create(1, static_cast<int>(requiredBytes), CV_8UC1);
+
+        const bool matches = buffer.view.data == buffer.storage.data && buffer.view.size() == size && buffer.view.type() == type;
+        if (matches == false)
+            buffer.view = cv::Mat(size, type, buffer.storage.data);
+
+        return buffer.view;
+    }
+
+
+    // Single channel version of image. Mono image is returned as is, color one is converted into 'buffer' with given code
+    export const cv::Mat& toGray(const cv::Mat& image, cv::Mat& buffer, int code = cv::COLOR_BGR2GRAY)
+    {
+        if (image.channels() == 1)
+            return image;
+
+        cv::cvtColor(image, buffer, code);
+        return buffer;
+    }
+
+    template<typename Pixel>
+    bool hasEqualChannels(const cv::Mat& image)
+    {
+        for (int y = 0; y < image.rows; y++)
+        {
+            const auto* row = image.ptr<Pixel>(y);
+
+            for (int x = 0; x < image.cols; x++)
+                if (row[x][0] != row[x][1] || row[x][1] != row[x][2])
+                    return false;
+        }
+
+        return true;
+    }
+
+    // Some sources (like video files) store mono images in three identical channels
+    export bool isMonochrome(const cv::Mat& image)
+    {
+        if (image.channels() == 1)
+            return true;
+
+        switch (image.type())
+        {
+            case CV_8UC3:
+                return hasEqualChannels<cv::Vec3b>(image);
+            case CV_16UC3:
+                return hasEqualChannels<cv::Vec3w>(image);
+            default:
+                return false;
+        }
+    }
+
+
     export void copyFile(const std::filesystem::path& from, const std::filesystem::path& to)
     {
-        std::filesystem::copy_file(from, to);
+        fileManager(to).copy(from, to);
+    }
+
+    // Make file available under new path without copying its content
+    export void linkFile(const std::filesystem::path& from, const std::filesystem::path& to)
+    {
+        fileManager(to).link(from, to);
+    }
+
+    // File names for 'files' put into one directory. Files from different directories may share names, such names get file's index appended.
+    // Names are compared without extensions, as writeImage may change them.
+    export std::vector<std::filesystem::path> uniqueFileNames(std::span<const std::filesystem::path> files)
+    {
+        std::vector<std::filesystem::path> names;
+        names.reserve(files.size());
+        std::set<std::string> usedStems;
+
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            const auto stem = files[i].stem().string();
+            auto name = stem;
+
+            for (size_t suffix = i + 1; usedStems.contains(name); suffix++)
+                name = std::format("{}-{}", stem, suffix);
+
+            usedStems.insert(name);
+            names.push_back(name + files[i].extension().string());
+        }
+
+        return names;
+    }
+
+    export std::vector<std::filesystem::path> linkFiles(std::span<const std::filesystem::path> from, const std::filesystem::path& to)
+    {
+        const auto names = uniqueFileNames(from);
+
+        std::vector<std::filesystem::path> result;
+        result.reserve(from.size());
+
+        for (size_t i = 0; i < from.size(); i++)
+        {
+            const auto newPath = to / names[i];
+            linkFile(from[i], newPath);
+
+            result.push_back(newPath);
+        }
+
+        return result;
     }
 
     export std::vector<std::filesystem::path> copyFiles(std::span<const std::filesystem::path> from, const std::filesystem::path& to)
@@ -188,7 +767,7 @@ namespace Utils
         WorkingDir getSubDir(std::string_view subdir)
         {
             const std::filesystem::path path = m_dir / std::format("#{} {}", m_c + 1, subdir);
-            std::filesystem::create_directories(path);
+            fileManager(path).create(path);
             m_c++;
 
             return WorkingDir(path);
@@ -197,7 +776,7 @@ namespace Utils
         WorkingDir getExactSubDir(std::string_view subdir) const
         {
             const std::filesystem::path path = m_dir / subdir;
-            std::filesystem::create_directories(path);
+            fileManager(path).create(path);
 
             return WorkingDir(path);
         }
@@ -238,6 +817,48 @@ namespace Utils
         return result;
     }
 
+    // Compare strings treating digit sequences as numbers, so 'frame-9' goes before 'frame-10'
+    export bool naturalLess(std::string_view lhs, std::string_view rhs)
+    {
+        constexpr std::string_view digits = "0123456789";
+        auto isDigit = [](char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; };
+
+        size_t l = 0, r = 0;
+        while (l < lhs.size() && r < rhs.size())
+        {
+            if (isDigit(lhs[l]) && isDigit(rhs[r]))
+            {
+                // compare numbers by value: drop leading zeros, then longer one is bigger
+                const auto lEnd = std::min(lhs.find_first_not_of(digits, l), lhs.size());
+                const auto rEnd = std::min(rhs.find_first_not_of(digits, r), rhs.size());
+                const auto lStart = std::min(lhs.find_first_not_of('0', l), lEnd);
+                const auto rStart = std::min(rhs.find_first_not_of('0', r), rEnd);
+
+                const auto lNumber = lhs.substr(lStart, lEnd - lStart);
+                const auto rNumber = rhs.substr(rStart, rEnd - rStart);
+
+                if (lNumber.size() != rNumber.size())
+                    return lNumber.size() < rNumber.size();
+
+                if (lNumber != rNumber)
+                    return lNumber < rNumber;
+
+                l = lEnd;
+                r = rEnd;
+            }
+            else
+            {
+                if (lhs[l] != rhs[r])
+                    return lhs[l] < rhs[r];
+
+                l++;
+                r++;
+            }
+        }
+
+        return lhs.size() - l < rhs.size() - r;
+    }
+
     export std::optional<std::tuple<int, int, int, int>> readCrop(std::string_view cropValue)
     {
         std::vector<std::string> split;
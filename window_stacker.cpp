@@ -0,0 +1,152 @@
+
+module;
+
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <iterator>
+#include <ranges>
+#include <set>
+#include <span>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <spdlog/spdlog.h>
+
+export module window_stacker;
+import images_aligner;
+import images_picker;
+import images_stacker;
+import progress;
+import utils;
+
+
+// Ranges [first, last) of frames of windows. Windows which would not be full are skipped unless there is only one window.
+export std::vector<std::pair<size_t, size_t>> windowRanges(size_t frames, size_t length, size_t step)
+{
+    std::vector<std::pair<size_t, size_t>> windows;
+
+    for (size_t first = 0; first == 0 || first + length <= frames; first += step)
+        windows.emplace_back(first, std::min(first + length, frames));
+
+    return windows;
+}
+
+
+namespace
+{
+    std::vector<std::filesystem::path> pathsOf(std::span<const size_t> indices, std::span<const std::filesystem::path> paths)
+    {
+        const auto selected = indices | std::views::transform([&](const size_t i) { return paths[i]; });
+        return {selected.begin(), selected.end()};
+    }
+
+    std::vector<cv::Mat> readImages(std::span<const std::filesystem::path> paths)
+    {
+        std::vector<cv::Mat> images(paths.size());
+
+        Utils::forEach(paths, [&](const size_t i)
+        {
+            images[i] = Utils::readImage(paths[i]);
+        });
+
+        return images;
+    }
+}
+
+
+// Stack overlapping windows of 'length' frames starting every 'step' frames.
+// Images are scored and aligned (to one reference for all windows) only once. Average stack follows the window:
+// images which are not picked anymore are removed from it and newly picked ones are added.
+export std::vector<std::filesystem::path> stackWindows(const std::filesystem::path& dir, std::span<const std::filesystem::path> images, size_t length, size_t step, const PickerMethod& method, const AlignmentOptions& alignmentOptions = {})
+{
+    if (images.empty())
+        return {};
+
+    const auto windows = windowRanges(images.size(), length, step);
+    const auto scores = scoreImages(images);
+
+    // progress is measured in stacked windows, as images are processed in a few passes
+    const auto progress = Progress::counter(dir);
+    progress.setTotal(windows.size());
+
+    // best images of each window as sorted indices of 'images'
+    std::vector<std::vector<size_t>> picks;
+    std::set<size_t> picked;
+
+    for (const auto& [first, last]: windows)
+    {
+        auto best = pickBest(std::span(scores).subspan(first, last - first), method);
+
+        for (auto& idx: best)
+            idx += first;
+
+        std::ranges::sort(best);
+        picked.insert(best.begin(), best.end());
+        picks.push_back(std::move(best));
+    }
+
+    // align all picked images to the best one
+    const std::vector<size_t> toAlign(picked.begin(), picked.end());
+    const auto toAlignPaths = pathsOf(toAlign, images);
+    const auto reference = std::ranges::max_element(toAlign, {}, [&](const size_t i) { return scores[i]; }) - toAlign.begin();
+    const auto alignment = calculateAlignment(toAlignPaths, static_cast<size_t>(reference), alignmentOptions);
+
+    const auto alignedDir = dir / "aligned";
+    Utils::fileManager(alignedDir).create(alignedDir);
+
+    std::vector<std::filesystem::path> aligned(images.size());
+    Utils::forEach(toAlign, [&](const size_t i)
+    {
+        if (alignment.isAligned(i) == false)
+            return;
+
+        const auto& imagePath = toAlignPaths[i];
+        const auto image = Utils::readImage(imagePath);
+
+        aligned[toAlign[i]] = Utils::writeImage(alignedDir / imagePath.filename(), alignImage(image, alignment, i));
+    });
+
+    AverageStack average;
+    std::vector<size_t> stacked;
+    std::vector<std::filesystem::path> results;
+
+    // images rejected by aligner are left out of windows
+    for (auto& pick: picks)
+        std::erase_if(pick, [&](const size_t i) { return aligned[i].empty(); });
+
+    for (size_t window = 0; window < windows.size(); window++)
+    {
+        const auto& pick = picks[window];
+
+        if (pick.empty())
+        {
+            spdlog::warn("Window #{} (frames {} - {}) skipped: none of its images could be aligned", window + 1, windows[window].first, windows[window].second - 1);
+            progress.advance();
+            continue;
+        }
+
+        std::vector<size_t> toRemove;
+        std::vector<size_t> toAdd;
+        std::ranges::set_difference(stacked, pick, std::back_inserter(toRemove));
+        std::ranges::set_difference(pick, stacked, std::back_inserter(toAdd));
+
+        for (const auto& image: readImages(pathsOf(toRemove, aligned)))
+            average.remove(image);
+
+        for (const auto& image: readImages(pathsOf(toAdd, aligned)))
+            average.add(image);
+
+        stacked = pick;
+
+        spdlog::debug("Window #{} (frames {} - {}): {} images added, {} removed", window + 1, windows[window].first, windows[window].second - 1, toAdd.size(), toRemove.size());
+
+        const auto name = std::format("{:04}", window + 1);
+        const auto medianImg = medianStacking(pathsOf(pick, aligned));
+
+        results.push_back(Utils::writeImage(dir / (name + "-average.png"), average.result(), Utils::ImageRole::Output));
+        results.push_back(Utils::writeImage(dir / (name + "-median.png"), medianImg, Utils::ImageRole::Output));
+        progress.advance();
+    }
+
+    return results;
+}